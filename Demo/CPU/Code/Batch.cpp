@@ -0,0 +1,459 @@
+/**
+ * Copyright (C) 2013 Jorge Jimenez (jorge@iryoku.com)
+ * Copyright (C) 2013 Jose I. Echevarria (joseignacioechevarria@gmail.com)
+ * Copyright (C) 2013 Belen Masia (bmasia@unizar.es)
+ * Copyright (C) 2013 Fernando Navarro (fernandn@microsoft.com)
+ * Copyright (C) 2013 Diego Gutierrez (diegog@unizar.es)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software. As clarification, there
+ * is no requirement that the copyright notice and permission be included in
+ * binary distributions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * Command-line batch tool, the headless counterpart of the DX10 demo command
+ * line. It takes the same parameters:
+ *     smaa [options] <threshold> <searchSteps> <diagSearchSteps> <cornerRounding> <in> <out>
+ *     smaa [options] <in> <out>
+ * where <in> and <out> can be files, or directories; and processes all the
+ * images with the same thread pool and SMAA object, which is only recreated
+ * when the size of the images changes. Files are memory mapped (see
+ * ImageFile.h), so there is no decoding nor copying.
+ *
+ * It can also run as a filter in a video pipeline, see stream().
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "FramePool.h"
+#include "LockFreePipe.h"
+#include "ImageFile.h"
+#include "SMAA.h"
+#include "VideoStream.h"
+using namespace std;
+namespace fs = std::filesystem;
+
+
+struct Options {
+    SMAA::Preset preset;
+    SMAA::Input input;
+    float threshold;
+    int searchSteps;
+    int diagSearchSteps;
+    float cornerRounding;
+    int threads;
+    bool srgb;
+    bool verbose;
+    string list;
+    Image raw; // Size and format of raw input files, if any.
+    bool stream;
+    int pipeline;
+} options = { SMAA::PRESET_HIGH, SMAA::INPUT_LUMA, 0.1f, 16, 8, 25.0f, 0, false, false, "", Image(), false, 2 };
+
+
+const struct {
+    const char *name;
+    Image::Format format;
+} formatNames[] = {
+    { "rgba8", Image::FORMAT_RGBA8 },
+    { "bgra8", Image::FORMAT_BGRA8 },
+    { "rgb8", Image::FORMAT_RGB8 },
+    { "bgr8", Image::FORMAT_BGR8 },
+    { "rgbx8", Image::FORMAT_RGBX8 },
+    { "rgb10a2", Image::FORMAT_RGB10A2 },
+    { "rgba16f", Image::FORMAT_RGBA16F },
+    { "rgba16", Image::FORMAT_RGBA16 },
+};
+
+
+void usage() {
+    fprintf(stderr,
+        "Usage: smaa [options] [<threshold> <searchSteps> <diagSearchSteps> <cornerRounding>] <in> <out>\n"
+        "       smaa [options] [<threshold> <searchSteps> <diagSearchSteps> <cornerRounding>] --list <file>\n"
+        "       smaa [options] [<threshold> <searchSteps> <diagSearchSteps> <cornerRounding>] --stream < in > out\n"
+        "\n"
+        "<in> and <out> are PPM, PAM, TGA or raw images, or directories, in which case\n"
+        "all the images in <in> are written to <out> with the same names. With --list,\n"
+        "each line of <file> holds an input and an output path ('-' reads from stdin).\n"
+        "With --stream, a YUV4MPEG2 stream (or raw frames, with --raw) is read from\n"
+        "stdin, and written to stdout. Giving the four numbers selects the custom preset.\n"
+        "\n"
+        "Options:\n"
+        "  --preset low|medium|high|ultra   Quality preset (default: high).\n"
+        "  --input luma|color               Edge detection input (default: luma).\n"
+        "  --srgb                           Blend in linear space, taking the images as sRGB.\n"
+        "  --raw <w>x<h>:<format>           Size and format of the raw input files, where\n"
+        "                                   <format> is rgba8, bgra8, rgb8, bgr8, rgbx8,\n"
+        "                                   rgb10a2, rgba16f or rgba16.\n"
+        "  --pipeline <n>                   Frames antialiased at the same time when\n"
+        "                                   streaming (default: 2).\n"
+        "  --threads <n>                    Worker threads (default: one per core).\n"
+        "  --verbose                        Print the time taken by each image.\n");
+    exit(2);
+}
+
+
+bool parseCommandLine(int argc, char **argv, vector<string> &positional) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        auto value = [&]() -> string {
+            if (i + 1 >= argc)
+                usage();
+            return argv[++i];
+        };
+
+        if (arg == "--preset") {
+            string v = value();
+            if (v == "low") options.preset = SMAA::PRESET_LOW;
+            else if (v == "medium") options.preset = SMAA::PRESET_MEDIUM;
+            else if (v == "high") options.preset = SMAA::PRESET_HIGH;
+            else if (v == "ultra") options.preset = SMAA::PRESET_ULTRA;
+            else return false;
+        } else if (arg == "--input") {
+            string v = value();
+            if (v == "luma") options.input = SMAA::INPUT_LUMA;
+            else if (v == "color") options.input = SMAA::INPUT_COLOR;
+            else return false;
+        } else if (arg == "--srgb")
+            options.srgb = true;
+        else if (arg == "--threads")
+            options.threads = atoi(value().c_str());
+        else if (arg == "--verbose")
+            options.verbose = true;
+        else if (arg == "--list")
+            options.list = value();
+        else if (arg == "--stream")
+            options.stream = true;
+        else if (arg == "--pipeline")
+            options.pipeline = max(atoi(value().c_str()), 1);
+        else if (arg == "--raw") {
+            string v = value();
+            int width = 0, height = 0, n = 0;
+            if (sscanf(v.c_str(), "%dx%d:%n", &width, &height, &n) != 2 || n == 0 || width <= 0 || height <= 0)
+                return false;
+            bool found = false;
+            for (auto &f : formatNames)
+                if (v.substr(n) == f.name) {
+                    options.raw = Image(nullptr, width, height, 0, f.format);
+                    found = true;
+                }
+            if (!found)
+                return false;
+        }
+        else if (arg.size() > 1 && arg[0] == '-' && !isdigit(arg[1]) && arg[1] != '.')
+            return false;
+        else
+            positional.push_back(arg);
+    }
+
+    // Same ranges as the DX10 demo:
+    size_t paths = options.list.empty() && !options.stream? 2 : 0;
+    if (positional.size() == paths + 4) {
+        options.preset = SMAA::PRESET_CUSTOM;
+        options.threshold = max(min(float(atof(positional[0].c_str())), 0.5f), 0.0f);
+        options.searchSteps = max(min(atoi(positional[1].c_str()), 112), 0);
+        options.diagSearchSteps = max(min(atoi(positional[2].c_str()), 20), 0);
+        options.cornerRounding = max(min(float(atof(positional[3].c_str())), 100.0f), 0.0f);
+        positional.erase(positional.begin(), positional.begin() + 4);
+    }
+    return positional.size() == paths;
+}
+
+
+/**
+ * Gathers the (input, output) pairs to process.
+ */
+bool listJobs(const vector<string> &positional, vector<pair<string, string>> &jobs) {
+    if (!options.list.empty()) {
+        ifstream file;
+        if (options.list != "-")
+            file.open(options.list);
+        istream &in = options.list == "-"? cin : file;
+        if (!in) {
+            fprintf(stderr, "smaa: cannot open %s\n", options.list.c_str());
+            return false;
+        }
+        string src, dst;
+        while (in >> src >> dst)
+            jobs.push_back(make_pair(src, dst));
+        return true;
+    }
+
+    error_code error;
+    if (!fs::is_directory(positional[0], error)) {
+        jobs.push_back(make_pair(positional[0], positional[1]));
+        return true;
+    }
+
+    fs::create_directories(positional[1], error);
+    for (auto &entry : fs::directory_iterator(positional[0], error)) {
+        string path = entry.path().string();
+        ImageFile::Type type;
+        if (entry.is_regular_file() && ImageFile::typeOf(path, type) && (type != ImageFile::TYPE_RAW || options.raw.width > 0))
+            jobs.push_back(make_pair(path, (fs::path(positional[1]) / entry.path().filename()).string()));
+    }
+    if (error) {
+        fprintf(stderr, "smaa: %s: %s\n", positional[0].c_str(), error.message().c_str());
+        return false;
+    }
+    sort(jobs.begin(), jobs.end());
+    return true;
+}
+
+
+Image::Format srgbFormat(Image::Format format) {
+    switch (format) {
+        case Image::FORMAT_RGBA8: return Image::FORMAT_RGBA8_SRGB;
+        case Image::FORMAT_BGRA8: return Image::FORMAT_BGRA8_SRGB;
+        case Image::FORMAT_RGB8: return Image::FORMAT_RGB8_SRGB;
+        case Image::FORMAT_BGR8: return Image::FORMAT_BGR8_SRGB;
+        case Image::FORMAT_RGBX8: return Image::FORMAT_RGBX8_SRGB;
+        default: return format;
+    }
+}
+
+
+unique_ptr<SMAA> createSMAA(int width, int height, ThreadPool &pool) {
+    unique_ptr<SMAA> smaa(new SMAA(width, height, options.preset, false, false, &pool));
+    smaa->setThreshold(options.threshold);
+    smaa->setMaxSearchSteps(options.searchSteps);
+    smaa->setMaxSearchStepsDiag(options.diagSearchSteps);
+    smaa->setCornerRounding(options.cornerRounding);
+    return smaa;
+}
+
+
+/**
+ * What is known of each buffer of the FramePool, besides its contents: the
+ * frame as stored in the stream, followed by the converted input and output,
+ * for YUV frames converted to RGBA.
+ */
+struct Frame {
+    int index;
+    string header;
+};
+
+
+/**
+ * Antialiases a video stream from stdin to stdout. Reading (and converting),
+ * antialiasing and writing run in their own threads, and 'pipeline' frames
+ * are antialiased at the same time, each with its own SMAA object, so that
+ * the passes of consecutive frames overlap on the pool. Frames are recycled
+ * through a FramePool, so memory stays constant, and nothing is allocated
+ * after the first frames.
+ */
+int stream() {
+    VideoStream video(options.raw.width > 0? &options.raw : nullptr);
+    static char inBuffer[1 << 20], outBuffer[1 << 20];
+    setvbuf(stdin, inBuffer, _IOFBF, sizeof(inBuffer));
+    setvbuf(stdout, outBuffer, _IOFBF, sizeof(outBuffer));
+    if (!video.readHeader(stdin) || !video.writeHeader(stdout)) {
+        fprintf(stderr, "smaa: %s\n", video.getError().empty()? strerror(errno) : video.getError().c_str());
+        return 1;
+    }
+
+    // Luma edge detection runs on the Y plane directly, see SMAA::goYUV;
+    // color and sRGB need the frames in RGBA:
+    const bool planar = video.isYUV() && options.input == SMAA::INPUT_LUMA && !options.srgb;
+    const bool convert = video.isYUV() && !planar;
+
+    const int width = video.getWidth(), height = video.getHeight();
+    const Image::Format format = options.srgb? srgbFormat(video.getFormat()) : video.getFormat();
+    const int pitch = width * Image::bytesPerPixel(format);
+
+    // One frame being read and one being written, besides the ones being
+    // antialiased:
+    const size_t frameSize = (video.getFrameSize() + 63) & ~size_t(63);
+    const size_t imageSize = size_t(pitch) * height;
+    FramePool buffers(options.pipeline + 2, convert? frameSize + 2 * imageSize : frameSize);
+    vector<Frame> frames(buffers.getCount());
+    auto rgba = [&](const FramePool::Handle &frame) { return Image(frame.data() + frameSize, width, height, pitch, format); };
+    auto aa = [&](const FramePool::Handle &frame) { return Image(frame.data() + frameSize + imageSize, width, height, pitch, format); };
+    ConcurrentQueue<FramePool::Handle> decoded(buffers.getCount()), done(buffers.getCount());
+
+    ThreadPool pool(options.threads);
+    thread reader([&] {
+        for (int index = 0;; index++) {
+            FramePool::Handle frame = buffers.acquire();
+            Frame &info = frames[frame.getIndex()];
+            if (!video.readFrame(stdin, frame.data(), info.header))
+                break;
+            info.index = index;
+            if (convert)
+                video.toRGBA(frame.data(), rgba(frame));
+            decoded.push(move(frame));
+        }
+        for (int i = 0; i < options.pipeline; i++)
+            decoded.push(FramePool::Handle());
+    });
+
+    vector<thread> workers;
+    for (int i = 0; i < options.pipeline; i++) {
+        workers.push_back(thread([&] {
+            unique_ptr<SMAA> smaa = createSMAA(width, height, pool);
+            for (FramePool::Handle frame = decoded.pop(); frame; frame = decoded.pop()) {
+                // Raw frames and YUV planes are antialiased in place, writing
+                // only the blended pixels:
+                if (planar) {
+                    Image planes[3];
+                    video.getPlanes(frame.data(), planes);
+                    smaa->goYUV(planes, planes);
+                } else if (convert)
+                    smaa->go(rgba(frame), Image(), Image(), aa(frame), options.input);
+                else {
+                    Image image(frame.data(), width, height, pitch, format);
+                    smaa->go(image, Image(), Image(), image, options.input);
+                }
+                done.push(move(frame));
+            }
+            done.push(FramePool::Handle());
+        }));
+    }
+
+    // Write the frames in order; there are never more than 'pipeline' of
+    // them waiting, one slot per buffer is enough to reorder them:
+    vector<FramePool::Handle> ready(buffers.getCount());
+    int next = 0, finished = 0;
+    bool failed = false;
+    auto start = chrono::steady_clock::now();
+    while (finished < options.pipeline) {
+        FramePool::Handle frame = done.pop();
+        if (!frame) {
+            finished++;
+            continue;
+        }
+        int slot = frames[frame.getIndex()].index % int(ready.size());
+        ready[slot] = move(frame);
+        for (FramePool::Handle *slot = &ready[next % ready.size()]; *slot; slot = &ready[++next % ready.size()]) {
+            frame = move(*slot);
+            const Frame &info = frames[frame.getIndex()];
+            if (convert)
+                video.fromRGBA(rgba(frame), aa(frame), frame.data());
+            if (!failed && !video.writeFrame(stdout, frame.data(), info.header)) {
+                fprintf(stderr, "smaa: %s\n", strerror(errno));
+                failed = true;
+            }
+
+            // Returns the buffer to the pool:
+            frame.reset();
+        }
+    }
+    reader.join();
+    for (auto &worker : workers)
+        worker.join();
+    fflush(stdout);
+
+    if (!video.getError().empty()) {
+        fprintf(stderr, "smaa: %s\n", video.getError().c_str());
+        failed = true;
+    }
+    if (options.verbose) {
+        double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        fprintf(stderr, "%d frames, %.2f ms per frame\n", next, elapsed / max(next, 1));
+    }
+    return failed? 1 : 0;
+}
+
+
+int main(int argc, char **argv) {
+    vector<string> positional;
+    if (!parseCommandLine(argc, argv, positional))
+        usage();
+
+    if (options.stream)
+        return stream();
+
+    vector<pair<string, string>> jobs;
+    if (!listJobs(positional, jobs))
+        return 1;
+
+    ThreadPool pool(options.threads);
+    unique_ptr<SMAA> smaa;
+    ImageFile src, dst;
+    int failures = 0;
+    double total = 0.0;
+
+    for (auto &job : jobs) {
+        // Files without a known extension are taken as raw, if a raw layout
+        // was given:
+        ImageFile::Type srcType, dstType;
+        bool srcRaw = options.raw.width > 0 && (!ImageFile::typeOf(job.first, srcType) || srcType == ImageFile::TYPE_RAW);
+        if (!ImageFile::typeOf(job.second, dstType))
+            dstType = ImageFile::TYPE_RAW;
+
+        // The output is truncated when created, so it can't be the input:
+        error_code error;
+        if (fs::equivalent(job.first, job.second, error)) {
+            fprintf(stderr, "smaa: %s: input and output are the same file\n", job.first.c_str());
+            failures++;
+            continue;
+        }
+
+        if (!src.open(job.first, srcRaw? &options.raw : nullptr)) {
+            fprintf(stderr, "smaa: %s\n", src.getError().c_str());
+            failures++;
+            continue;
+        }
+        Image in = src.getImage();
+        if (!Image::isColor(in.format)) {
+            fprintf(stderr, "smaa: %s: not a color image\n", job.first.c_str());
+            failures++;
+            continue;
+        }
+        if (!dst.create(job.second, dstType, in.width, in.height, in.format)) {
+            fprintf(stderr, "smaa: %s\n", dst.getError().c_str());
+            failures++;
+            continue;
+        }
+
+        // Keep the engine (and its intermediate buffers) across images of
+        // the same size:
+        if (!smaa || smaa->getWidth() != in.width || smaa->getHeight() != in.height)
+            smaa = createSMAA(in.width, in.height, pool);
+
+        // Both files are mapped, so SMAA reads and writes them directly:
+        Image::Format format = options.srgb? srgbFormat(in.format) : in.format;
+        auto start = chrono::steady_clock::now();
+        smaa->go(src.getImage(format), Image(), Image(), dst.getImage(format), options.input);
+        double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        total += elapsed;
+        src.close();
+        dst.close();
+
+        if (options.verbose)
+            fprintf(stderr, "%s -> %s: %.2f ms\n", job.first.c_str(), job.second.c_str(), elapsed);
+    }
+
+    if (options.verbose && !jobs.empty())
+        fprintf(stderr, "%d images, %.2f ms per image\n", int(jobs.size()) - failures, total / max(int(jobs.size()) - failures, 1));
+    return failures > 0? 1 : 0;
+}
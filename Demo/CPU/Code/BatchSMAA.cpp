@@ -0,0 +1,230 @@
+/**
+ * Copyright (C) 2013 Jorge Jimenez (jorge@iryoku.com)
+ * Copyright (C) 2013 Jose I. Echevarria (joseignacioechevarria@gmail.com)
+ * Copyright (C) 2013 Belen Masia (bmasia@unizar.es)
+ * Copyright (C) 2013 Fernando Navarro (fernandn@microsoft.com)
+ * Copyright (C) 2013 Diego Gutierrez (diegog@unizar.es)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software. As clarification, there
+ * is no requirement that the copyright notice and permission be included in
+ * binary distributions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include "BatchSMAA.h"
+using namespace std;
+
+
+BatchSMAA::BatchSMAA(ThreadPool *pool)
+        : pool(pool),
+          ownsPool(pool == nullptr) {
+    if (ownsPool)
+        this->pool = new ThreadPool();
+
+    serialPools.resize(this->pool->getThreadCount());
+    engines.resize(this->pool->getThreadCount());
+}
+
+
+BatchSMAA::~BatchSMAA() {
+    // The objects must go before the pools they use:
+    engines.clear();
+    shared.reset();
+    if (ownsPool)
+        delete pool;
+}
+
+
+void BatchSMAA::go(const Item *items, int count) {
+    for (int i = 0; i < count; i++)
+        assert(items[i].mode == SMAA::MODE_SMAA_1X || items[i].mode == SMAA::MODE_SMAA_S2X);
+
+    if (count < pool->getThreadCount()) {
+        // Not enough images to keep all threads busy; better to split each
+        // of them in bands:
+        for (int i = 0; i < count; i++) {
+            const Item &item = items[i];
+            if (!shared)
+                shared.reset(new SMAA(item.src.width, item.src.height, item.preset, false, false, pool));
+            setup(*shared, item);
+            shared->go(item.src, item.depth, Image(), item.dst, item.input, item.mode);
+        }
+        return;
+    }
+
+    pool->parallelFor(count, [&](int i, int thread) {
+        const Item &item = items[i];
+        SMAA &smaa = getSMAA(thread, item);
+        setup(smaa, item);
+        smaa.go(item.src, item.depth, Image(), item.dst, item.input, item.mode);
+    });
+}
+
+
+/**
+ * Tells whether two rectangles share any pixel.
+ */
+static bool overlap(const SMAA::Rect &a, const SMAA::Rect &b) {
+    return a.width > 0 && a.height > 0 && b.width > 0 && b.height > 0 &&
+           a.x < b.x + b.width && b.x < a.x + a.width &&
+           a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+
+void BatchSMAA::goRegions(const Image &src, const Image &depth, const Image &dst,
+                          const Region *regions, int count,
+                          SMAA::Mode mode) {
+    for (int i = 0; i < count; i++) {
+        for (int j = i + 1; j < count; j++) {
+            bool disjoint = !overlap(regions[i].rect, regions[j].rect);
+            assert(disjoint);
+            (void) disjoint;
+        }
+    }
+
+    regionItems.clear();
+    for (int i = 0; i < count; i++) {
+        const SMAA::Rect &rect = regions[i].rect;
+        assert(rect.x >= 0 && rect.y >= 0 && rect.x + rect.width <= src.width && rect.y + rect.height <= src.height);
+        if (rect.width <= 0 || rect.height <= 0)
+            continue;
+
+        regionItems.push_back(Item());
+        Item &item = regionItems.back();
+        item.src = src.crop(rect.x, rect.y, rect.width, rect.height);
+        item.depth = depth.crop(rect.x, rect.y, rect.width, rect.height);
+        item.dst = dst.crop(rect.x, rect.y, rect.width, rect.height);
+        item.input = regions[i].input;
+        item.preset = regions[i].preset;
+        item.mode = mode;
+        item.threshold = regions[i].threshold;
+        item.cornerRounding = regions[i].cornerRounding;
+        item.maxSearchSteps = regions[i].maxSearchSteps;
+        item.maxSearchStepsDiag = regions[i].maxSearchStepsDiag;
+    }
+    go(regionItems.data(), int(regionItems.size()));
+}
+
+
+void BatchSMAA::goAtlas(const Item *items, int count) {
+    if (count == 0)
+        return;
+
+    const Item &first = items[0];
+    for (int i = 0; i < count; i++) {
+        const Item &item = items[i];
+        assert(item.mode == SMAA::MODE_SMAA_1X && item.src.samples == 1 && item.input != SMAA::INPUT_DEPTH);
+        assert(item.src.format == first.src.format && item.input == first.input && item.preset == first.preset);
+        assert(item.threshold == first.threshold && item.cornerRounding == first.cornerRounding &&
+               item.maxSearchSteps == first.maxSearchSteps && item.maxSearchStepsDiag == first.maxSearchStepsDiag);
+        (void) item;
+    }
+
+    if (!shared)
+        shared.reset(new SMAA(first.src.width, first.src.height, first.preset, false, false, pool));
+    setup(*shared, first);
+    const int guard = shared->getHalo();
+
+    // Shelf packing, tallest images first, in a canvas about as wide as
+    // tall:
+    order.resize(count);
+    iota(order.begin(), order.end(), 0);
+    sort(order.begin(), order.end(), [&](int a, int b) { return items[a].src.height > items[b].src.height; });
+    double area = 0.0;
+    int widest = 0;
+    for (int i = 0; i < count; i++) {
+        area += double(items[i].src.width + 2 * guard) * (items[i].src.height + 2 * guard);
+        widest = max(widest, items[i].src.width + 2 * guard);
+    }
+    int canvasWidth = max(widest, int(ceil(sqrt(area))));
+    int x = 0, y = 0, shelf = 0;
+    positions.resize(2 * count);
+    for (int i : order) {
+        int cellWidth = items[i].src.width + 2 * guard, cellHeight = items[i].src.height + 2 * guard;
+        if (x + cellWidth > canvasWidth) {
+            x = 0;
+            y += shelf;
+            shelf = 0;
+        }
+        positions[2 * i] = x + guard;
+        positions[2 * i + 1] = y + guard;
+        x += cellWidth;
+        shelf = max(shelf, cellHeight);
+    }
+    int canvasHeight = y + shelf;
+
+    // The free space left by the packing is never read, as it is further
+    // than the halo from any image:
+    const Image::Format format = first.src.format;
+    const int bpp = Image::bytesPerPixel(format);
+    const int pitch = canvasWidth * bpp;
+    atlas.resize(size_t(pitch) * canvasHeight);
+    Image canvas(atlas.data(), canvasWidth, canvasHeight, pitch, format);
+
+    pool->parallelFor(count, [&](int i, int) {
+        const Image &src = items[i].src;
+        int x0 = positions[2 * i], y0 = positions[2 * i + 1];
+        for (int y = -guard; y < src.height + guard; y++) {
+            const unsigned char *in = src.row(min(max(y, 0), src.height - 1));
+            unsigned char *out = canvas.row(y0 + y) + size_t(x0) * bpp;
+            memcpy(out, in, size_t(src.width) * bpp);
+            for (int x = 1; x <= guard; x++) {
+                memcpy(out - x * bpp, in, bpp);
+                memcpy(out + (src.width - 1 + x) * bpp, in + (src.width - 1) * bpp, bpp);
+            }
+        }
+    });
+
+    // In place, so that only the blended pixels are written:
+    shared->resize(canvasWidth, canvasHeight);
+    shared->go(canvas, Image(), Image(), canvas, first.input);
+
+    pool->parallelFor(count, [&](int i, int) {
+        const Image &dst = items[i].dst;
+        int x0 = positions[2 * i], y0 = positions[2 * i + 1];
+        for (int y = 0; y < dst.height; y++)
+            memcpy(dst.row(y), canvas.row(y0 + y) + size_t(x0) * bpp, size_t(dst.width) * bpp);
+    });
+}
+
+
+SMAA &BatchSMAA::getSMAA(int thread, const Item &item) {
+    // Each thread creates its own object the first time, so no locking is
+    // needed:
+    if (!engines[thread]) {
+        serialPools[thread].reset(new ThreadPool(1));
+        engines[thread].reset(new SMAA(item.src.width, item.src.height, item.preset, false, false, serialPools[thread].get()));
+    }
+    return *engines[thread];
+}
+
+
+void BatchSMAA::setup(SMAA &smaa, const Item &item) {
+    smaa.resize(item.src.width, item.src.height);
+    smaa.setPreset(item.preset);
+    smaa.setThreshold(item.threshold);
+    smaa.setCornerRounding(item.cornerRounding);
+    smaa.setMaxSearchSteps(item.maxSearchSteps);
+    smaa.setMaxSearchStepsDiag(item.maxSearchStepsDiag);
+}
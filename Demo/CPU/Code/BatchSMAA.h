@@ -0,0 +1,185 @@
+/**
+ * Copyright (C) 2013 Jorge Jimenez (jorge@iryoku.com)
+ * Copyright (C) 2013 Jose I. Echevarria (joseignacioechevarria@gmail.com)
+ * Copyright (C) 2013 Belen Masia (bmasia@unizar.es)
+ * Copyright (C) 2013 Fernando Navarro (fernandn@microsoft.com)
+ * Copyright (C) 2013 Diego Gutierrez (diegog@unizar.es)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software. As clarification, there
+ * is no requirement that the copyright notice and permission be included in
+ * binary distributions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef BATCHSMAA_H
+#define BATCHSMAA_H
+
+#include <memory>
+#include <vector>
+#include "SMAA.h"
+
+/**
+ * Runs SMAA 1x or S2x over many independent images at once, such as the
+ * thumbnails of a texture atlas, the layers of an array, or the two eyes of
+ * a stereo pair. Each image can have its own size, format and parameters.
+ *
+ * Running one SMAA object per image would dispatch three passes per image to
+ * the pool, which is mostly synchronization overhead for small images, and
+ * allocate storage for each of them. Instead, all images are scheduled in a
+ * single parallelFor: each thread of the pool owns an SMAA object, working
+ * serially, whose storage grows to the largest image it has processed and is
+ * then reused for the rest. When there are fewer images than threads, each
+ * one is spread over the whole pool instead, one after the other.
+ *
+ * Array layers and stereo pairs are just one Item per layer or eye, with an
+ * Image pointing into the memory of each of them.
+ */
+class BatchSMAA {
+    public:
+        class Item;
+
+        /**
+         * If 'pool' is nullptr, a pool with one thread per core is created
+         * for this object.
+         */
+        BatchSMAA(ThreadPool *pool=nullptr);
+        ~BatchSMAA();
+
+        /**
+         * Antialiases the 'count' items and returns when all of them are
+         * done. Same as calling SMAA::go for each of them, with the
+         * parameters of the item.
+         */
+        void go(const Item *items, int count);
+
+        /**
+         * @ATLAS
+         *
+         * Packs tiny images, like sprites and icons, into a single canvas,
+         * which is antialiased as one frame, and then copies the results
+         * back. Each image is surrounded by copies of its border pixels, as
+         * wide as SMAA::getHalo, so that edges never bleed from one image
+         * into another. The results are those of go(), except for the last
+         * column and row of each image: go() takes the blending weights of
+         * the pixels beyond them from the border pixels themselves (clamp
+         * addressing), while here they come from the copies.
+         *
+         * The guards are antialiased as well, and they grow with the search
+         * distances, so this only pays off when the cost of each call is
+         * larger than that of the guards (go() already avoids most of it).
+         *
+         * All the items must share format, input (luma or color), preset and
+         * parameters, and use MODE_SMAA_1X.
+         */
+        void goAtlas(const Item *items, int count);
+
+        /**
+         * @REGIONS
+         *
+         * Antialiases several rectangles of the same frame, such as the
+         * viewports of a split screen, each one with its own input, preset
+         * and parameters, where the DX10 demo would set a scissor rectangle
+         * for each. Each region is antialiased as an image of its own, a
+         * view into 'src' and 'dst' (see Image::crop), so the searches stop
+         * at its borders as they do at the borders of a frame, and the pixels
+         * outside all regions are left untouched. They are scheduled as the
+         * items of go().
+         *
+         * Regions must not overlap (this is asserted): they are antialiased
+         * at the same time, so the pixels they share would be written by two
+         * threads, and with 'dst' being 'src', read by one while the other
+         * writes them. 'dst' can be 'src', and 'depth' is only needed for
+         * INPUT_DEPTH; 'mode' is MODE_SMAA_1X or MODE_SMAA_S2X.
+         */
+        class Region;
+        void goRegions(const Image &src, const Image &depth, const Image &dst,
+                       const Region *regions, int count,
+                       SMAA::Mode mode=SMAA::MODE_SMAA_1X);
+
+        class Item {
+            public:
+                Item(const Image &src=Image(),
+                     const Image &dst=Image(),
+                     SMAA::Input input=SMAA::INPUT_LUMA,
+                     SMAA::Preset preset=SMAA::PRESET_HIGH,
+                     SMAA::Mode mode=SMAA::MODE_SMAA_1X)
+                    : src(src),
+                      dst(dst),
+                      input(input),
+                      preset(preset),
+                      mode(mode),
+                      threshold(0.1f),
+                      cornerRounding(25.0f),
+                      maxSearchSteps(16),
+                      maxSearchStepsDiag(8) {}
+
+            Image src, depth, dst; // As in SMAA::go; 'depth' is only needed for INPUT_DEPTH.
+            SMAA::Input input;
+            SMAA::Preset preset;
+            SMAA::Mode mode; // MODE_SMAA_1X or MODE_SMAA_S2X.
+
+            // Only used with PRESET_CUSTOM:
+            float threshold, cornerRounding;
+            int maxSearchSteps, maxSearchStepsDiag;
+        };
+
+        class Region {
+            public:
+                Region(const SMAA::Rect &rect=SMAA::Rect(),
+                       SMAA::Input input=SMAA::INPUT_LUMA,
+                       SMAA::Preset preset=SMAA::PRESET_HIGH)
+                    : rect(rect),
+                      input(input),
+                      preset(preset),
+                      threshold(0.1f),
+                      cornerRounding(25.0f),
+                      maxSearchSteps(16),
+                      maxSearchStepsDiag(8) {}
+
+            SMAA::Rect rect;
+            SMAA::Input input;
+            SMAA::Preset preset;
+
+            // Only used with PRESET_CUSTOM:
+            float threshold, cornerRounding;
+            int maxSearchSteps, maxSearchStepsDiag;
+        };
+
+    private:
+        SMAA &getSMAA(int thread, const Item &item);
+        static void setup(SMAA &smaa, const Item &item);
+
+        ThreadPool *pool;
+        bool ownsPool;
+
+        // One serial object per thread of the pool, plus one using the whole
+        // pool for the images that are antialiased one at a time:
+        std::vector<std::unique_ptr<ThreadPool>> serialPools;
+        std::vector<std::unique_ptr<SMAA>> engines;
+        std::unique_ptr<SMAA> shared;
+
+        // The canvas for goAtlas, and the position of each image in it:
+        std::vector<unsigned char> atlas;
+        std::vector<int> order, positions;
+
+        // The regions of goRegions, as items:
+        std::vector<Item> regionItems;
+};
+
+#endif
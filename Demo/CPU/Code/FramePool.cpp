@@ -0,0 +1,140 @@
+/**
+ * Copyright (C) 2013 Jorge Jimenez (jorge@iryoku.com)
+ * Copyright (C) 2013 Jose I. Echevarria (joseignacioechevarria@gmail.com)
+ * Copyright (C) 2013 Belen Masia (bmasia@unizar.es)
+ * Copyright (C) 2013 Fernando Navarro (fernandn@microsoft.com)
+ * Copyright (C) 2013 Diego Gutierrez (diegog@unizar.es)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software. As clarification, there
+ * is no requirement that the copyright notice and permission be included in
+ * binary distributions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <cassert>
+#include <new>
+#include "FramePool.h"
+using namespace std;
+
+
+// Marks the end of the free list:
+#define FRAMEPOOL_EMPTY 0xffffffffu
+
+
+FramePool::FramePool(int count, size_t size)
+        : count(count),
+          size(size),
+          stride((size + 63) & ~size_t(63)),
+          memory((unsigned char *) operator new(stride * count, align_val_t(64))),
+          references(new atomic<int>[count]),
+          next(new atomic<unsigned int>[count]),
+          head(FRAMEPOOL_EMPTY),
+          waiters(0) {
+    for (int i = count - 1; i >= 0; i--) {
+        references[i] = 0;
+        push(i);
+    }
+}
+
+
+FramePool::~FramePool() {
+    // All handles must have been released by now:
+    operator delete(memory, align_val_t(64));
+}
+
+
+FramePool::Handle FramePool::acquire() {
+    int index;
+    if (pop(index))
+        return Handle(this, index);
+
+    // All buffers are in use; register as a waiter before checking again, so
+    // that a buffer returned in between either is seen here, or notifies:
+    waiters++;
+    {
+        unique_lock<std::mutex> lock(mutex);
+        available.wait(lock, [&] { return pop(index); });
+    }
+    waiters--;
+    return Handle(this, index);
+}
+
+
+FramePool::Handle FramePool::tryAcquire() {
+    int index;
+    return pop(index)? Handle(this, index) : Handle();
+}
+
+
+bool FramePool::pop(int &index) {
+    unsigned long long top = head.load();
+    for (;;) {
+        unsigned int i = (unsigned int) top;
+        if (i == FRAMEPOOL_EMPTY)
+            return false;
+        unsigned long long desired = (((top >> 32) + 1) << 32) | next[i].load(memory_order_relaxed);
+        if (head.compare_exchange_weak(top, desired)) {
+            references[i].store(1, memory_order_relaxed);
+            index = int(i);
+            return true;
+        }
+    }
+}
+
+
+void FramePool::push(int index) {
+    unsigned long long top = head.load(memory_order_relaxed);
+    unsigned long long desired;
+    do {
+        next[index].store((unsigned int) top, memory_order_relaxed);
+        desired = (((top >> 32) + 1) << 32) | (unsigned int) index;
+    } while (!head.compare_exchange_weak(top, desired));
+
+    // Only wake up acquire() if it is actually waiting:
+    if (waiters.load() > 0) {
+        lock_guard<std::mutex> lock(mutex);
+        available.notify_one();
+    }
+}
+
+
+FramePool::Handle::Handle(const Handle &other) : pool(other.pool), index(other.index) {
+    if (pool != nullptr)
+        pool->references[index].fetch_add(1, memory_order_relaxed);
+}
+
+
+FramePool::Handle &FramePool::Handle::operator=(Handle other) noexcept {
+    swap(pool, other.pool);
+    swap(index, other.index);
+    return *this;
+}
+
+
+void FramePool::Handle::reset() {
+    if (pool == nullptr)
+        return;
+
+    // The last reference returns the buffer; acquire-release ordering makes
+    // the writes through the other handles visible to the next owner:
+    if (pool->references[index].fetch_sub(1, memory_order_acq_rel) == 1)
+        pool->push(index);
+    pool = nullptr;
+    index = -1;
+}
@@ -0,0 +1,125 @@
+/**
+ * Copyright (C) 2013 Jorge Jimenez (jorge@iryoku.com)
+ * Copyright (C) 2013 Jose I. Echevarria (joseignacioechevarria@gmail.com)
+ * Copyright (C) 2013 Belen Masia (bmasia@unizar.es)
+ * Copyright (C) 2013 Fernando Navarro (fernandn@microsoft.com)
+ * Copyright (C) 2013 Diego Gutierrez (diegog@unizar.es)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software. As clarification, there
+ * is no requirement that the copyright notice and permission be included in
+ * binary distributions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+/**
+ * A fixed set of buffers of the same size, for the frames flowing through a
+ * streaming pipeline. Buffers are handed out as reference counted handles,
+ * which the stages pass along (or share, for example with a history); the
+ * buffer goes back to the pool when the last handle is released.
+ *
+ * Both taking and returning buffers are lock-free, with no system or
+ * allocator calls; acquire() only blocks, on a condition variable, when all
+ * the buffers are in use. Buffers are 64-byte aligned, and allocated once, in
+ * a single block.
+ */
+class FramePool {
+    public:
+        class Handle;
+
+        FramePool(int count, size_t size);
+        ~FramePool();
+
+        /**
+         * Takes a free buffer, waiting for one if there are none.
+         */
+        Handle acquire();
+
+        /**
+         * Same, but returns an empty handle if all buffers are in use.
+         */
+        Handle tryAcquire();
+
+        int getCount() const { return count; }
+        size_t getSize() const { return size; }
+
+        class Handle {
+            public:
+                Handle() : pool(nullptr), index(-1) {}
+                Handle(const Handle &other);
+                Handle(Handle &&other) noexcept : pool(other.pool), index(other.index) { other.pool = nullptr; other.index = -1; }
+                Handle &operator=(Handle other) noexcept;
+                ~Handle() { reset(); }
+
+                /**
+                 * Releases this reference, returning the buffer to the pool
+                 * if it was the last one.
+                 */
+                void reset();
+
+                unsigned char *data() const { return pool->memory + pool->stride * index; }
+                size_t size() const { return pool->size; }
+
+                /**
+                 * Index of the buffer in the pool, in [0, getCount()), for
+                 * keeping per-buffer data alongside.
+                 */
+                int getIndex() const { return index; }
+
+                explicit operator bool() const { return pool != nullptr; }
+
+            private:
+                friend class FramePool;
+                Handle(FramePool *pool, int index) : pool(pool), index(index) {}
+
+                FramePool *pool;
+                int index;
+        };
+
+    private:
+        bool pop(int &index);
+        void push(int index);
+
+        int count;
+        size_t size, stride;
+        unsigned char *memory;
+        std::unique_ptr<std::atomic<int>[]> references;
+
+        // Free list, as a stack linked through 'next'. 'head' holds the index
+        // of the top buffer in the low 32 bits, and a counter of the changes
+        // in the high ones, so that a pop can't succeed against a head that
+        // was popped and pushed back in between (the ABA problem):
+        std::unique_ptr<std::atomic<unsigned int>[]> next;
+        std::atomic<unsigned long long> head;
+
+        // Only used when acquire() has to wait:
+        std::atomic<int> waiters;
+        std::mutex mutex;
+        std::condition_variable available;
+};
+
+#endif
@@ -0,0 +1,119 @@
+/**
+ * Copyright (C) 2013 Jorge Jimenez (jorge@iryoku.com)
+ * Copyright (C) 2013 Jose I. Echevarria (joseignacioechevarria@gmail.com)
+ * Copyright (C) 2013 Belen Masia (bmasia@unizar.es)
+ * Copyright (C) 2013 Fernando Navarro (fernandn@microsoft.com)
+ * Copyright (C) 2013 Diego Gutierrez (diegog@unizar.es)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software. As clarification, there
+ * is no requirement that the copyright notice and permission be included in
+ * binary distributions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+/**
+ * This is a non-owning view of a 2D image stored in memory, the CPU
+ * counterpart of a shader resource view or render target view. 'pitch' is the
+ * distance in bytes between the start of two consecutive rows, so padded and
+ * sub-rectangle views can be passed as they are. It can be negative for
+ * images stored bottom-up, with 'data' pointing to the top row.
+ *
+ * Multisampled images store their 'samples' subsamples interleaved, one after
+ * the other for each pixel, so that a row takes width * samples pixels.
+ *
+ * Color images can be given in any of the FORMAT_RGBA8 to FORMAT_RGBX8_SRGB
+ * layouts. SMAA reads and writes them as they are, so there is no need to
+ * convert frames coming from capture cards or renderers. The 64-bit formats
+ * are expected to hold linear colors, before tonemapping. The _SRGB formats
+ * hold the same gamma space bytes as their plain counterparts, but are
+ * blended in linear space, as the GPU does through sRGB views.
+ */
+class Image {
+    public:
+        enum Format {
+            FORMAT_RGBA8, // R8G8B8A8_UNORM, the usual color format.
+            FORMAT_BGRA8, // B8G8R8A8_UNORM.
+            FORMAT_RGB8, // R8G8B8_UNORM, three bytes per pixel.
+            FORMAT_BGR8, // B8G8R8_UNORM, as in 24-bit TGA files.
+            FORMAT_RGBX8, // R8G8B8X8_UNORM, the fourth byte is ignored.
+            FORMAT_RGB10A2, // R10G10B10A2_UNORM.
+            FORMAT_RGBA16F, // R16G16B16A16_FLOAT, linear.
+            FORMAT_RGBA16, // R16G16B16A16_UNORM, linear.
+            FORMAT_RGBA8_SRGB, // R8G8B8A8_UNORM_SRGB.
+            FORMAT_BGRA8_SRGB, // B8G8R8A8_UNORM_SRGB.
+            FORMAT_RGB8_SRGB, // R8G8B8_UNORM_SRGB.
+            FORMAT_BGR8_SRGB, // B8G8R8_UNORM_SRGB.
+            FORMAT_RGBX8_SRGB, // R8G8B8X8_UNORM_SRGB.
+            FORMAT_R8, // R8_UNORM, only used for the edges.
+            FORMAT_R32F, // R32_FLOAT, for depth and predication buffers.
+            FORMAT_RG16F, // R16G16_FLOAT, for velocity buffers.
+        };
+
+        Image() : data(nullptr), width(0), height(0), pitch(0), format(FORMAT_RGBA8), samples(1) {}
+        Image(void *data, int width, int height, int pitch, Format format=FORMAT_RGBA8, int samples=1)
+            : data(data), width(width), height(height), pitch(pitch), format(format), samples(samples) {}
+
+        unsigned char *row(int y) const { return (unsigned char *) data + (long long) y * pitch; }
+
+        bool isValid() const { return data != nullptr; }
+
+        /**
+         * View of the rectangle of 'width' x 'height' pixels at (x, y), which
+         * must be inside the image. Empty images give empty views.
+         */
+        Image crop(int x, int y, int width, int height) const {
+            if (!isValid())
+                return Image();
+            return Image(row(y) + x * samples * bytesPerPixel(format), width, height, pitch, format, samples);
+        }
+
+        static bool isColor(Format format) { return format <= FORMAT_RGBX8_SRGB; }
+
+        static int bytesPerPixel(Format format) {
+            switch (format) {
+                case FORMAT_RGBA8: return 4;
+                case FORMAT_BGRA8: return 4;
+                case FORMAT_RGB8: return 3;
+                case FORMAT_BGR8: return 3;
+                case FORMAT_RGBX8: return 4;
+                case FORMAT_RGB10A2: return 4;
+                case FORMAT_RGBA16F: return 8;
+                case FORMAT_RGBA16: return 8;
+                case FORMAT_RGBA8_SRGB: return 4;
+                case FORMAT_BGRA8_SRGB: return 4;
+                case FORMAT_RGB8_SRGB: return 3;
+                case FORMAT_BGR8_SRGB: return 3;
+                case FORMAT_RGBX8_SRGB: return 4;
+                case FORMAT_R8: return 1;
+                case FORMAT_R32F: return 4;
+                case FORMAT_RG16F: return 4;
+                default: return 0;
+            }
+        }
+
+        void *data;
+        int width, height, pitch;
+        Format format;
+        int samples;
+};
+
+#endif
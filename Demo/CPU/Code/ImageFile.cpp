@@ -0,0 +1,328 @@
+/**
+ * Copyright (C) 2013 Jorge Jimenez (jorge@iryoku.com)
+ * Copyright (C) 2013 Jose I. Echevarria (joseignacioechevarria@gmail.com)
+ * Copyright (C) 2013 Belen Masia (bmasia@unizar.es)
+ * Copyright (C) 2013 Fernando Navarro (fernandn@microsoft.com)
+ * Copyright (C) 2013 Diego Gutierrez (diegog@unizar.es)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software. As clarification, there
+ * is no requirement that the copyright notice and permission be included in
+ * binary distributions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ImageFile.h"
+using namespace std;
+
+
+namespace {
+
+/**
+ * Reads the whitespace separated tokens of a Netpbm header, skipping
+ * comments.
+ */
+class HeaderReader {
+    public:
+        HeaderReader(const unsigned char *data, size_t size) : data(data), size(size), pos(0) {}
+
+        string token() {
+            string s;
+            while (pos < size) {
+                char c = char(data[pos++]);
+                if (c == '#') {
+                    while (pos < size && data[pos] != '\n')
+                        pos++;
+                } else if (isspace((unsigned char) c)) {
+                    // The single whitespace after the last token is part of
+                    // the header:
+                    if (!s.empty())
+                        break;
+                } else
+                    s += c;
+            }
+            return s;
+        }
+
+        // Returns -1 for anything but a number that fits an int:
+        int number() {
+            string s = token();
+            char *end;
+            errno = 0;
+            long n = strtol(s.c_str(), &end, 10);
+            if (s.empty() || *end != '\0' || errno != 0 || n < 0 || n > INT_MAX)
+                return -1;
+            return int(n);
+        }
+
+        size_t position() const { return pos; }
+
+    private:
+        const unsigned char *data;
+        size_t size, pos;
+};
+
+unsigned short readShort(const unsigned char *p) {
+    return (unsigned short) (p[0] | (p[1] << 8));
+}
+
+void writeShort(unsigned char *p, int v) {
+    p[0] = (unsigned char) v;
+    p[1] = (unsigned char) (v >> 8);
+}
+
+/**
+ * Checks that the rows of an image fit the int pitch of Image, and that the
+ * whole image fits in memory, before any size is calculated from them.
+ */
+bool validSize(int width, int height, int bpp) {
+    return width > 0 && height > 0 && width <= INT_MAX / bpp &&
+           size_t(height) <= SIZE_MAX / (size_t(width) * bpp);
+}
+
+} // namespace
+
+
+bool ImageFile::open(const string &path, const Image *raw) {
+    close();
+
+    Type type = TYPE_RAW;
+    if (raw == nullptr && !typeOf(path, type)) {
+        error = path + ": unknown file type";
+        return false;
+    }
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = path + ": " + strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        mapSize = size_t(st.st_size);
+        map = mmap(nullptr, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    int mapError = errno;
+    ::close(fd);
+    if (map == nullptr || map == MAP_FAILED) {
+        map = nullptr;
+        error = path + ": " + (mapSize == 0? "empty file" : strerror(mapError));
+        return false;
+    }
+
+    if (raw != nullptr) {
+        if (!validSize(raw->width, raw->height, Image::bytesPerPixel(raw->format))) {
+            error = path + ": invalid image size";
+            close();
+            return false;
+        }
+        image = Image(map, raw->width, raw->height, raw->width * Image::bytesPerPixel(raw->format), raw->format);
+    } else if (!parseHeader(path, type)) {
+        close();
+        return false;
+    }
+
+    // Check that all the rows are in the file (the size was validated, so
+    // none of this overflows):
+    const unsigned char *first = image.row(image.pitch < 0? image.height - 1 : 0);
+    size_t offset = size_t(first - (const unsigned char *) map);
+    size_t size = size_t(image.width) * Image::bytesPerPixel(image.format) * image.height;
+    if (offset > mapSize || size > mapSize - offset) {
+        error = path + ": truncated file";
+        close();
+        return false;
+    }
+    return true;
+}
+
+
+bool ImageFile::parseHeader(const string &path, Type type) {
+    const unsigned char *data = (const unsigned char *) map;
+    int width = 0, height = 0, depth = 0, maxval = 0;
+    size_t offset = 0;
+
+    if (type == TYPE_TGA) {
+        if (mapSize < 18 || data[1] != 0 || data[2] != 2 || (data[16] != 24 && data[16] != 32)) {
+            error = path + ": only uncompressed 24 and 32-bit TGA files are supported";
+            return false;
+        }
+        width = readShort(data + 12);
+        height = readShort(data + 14);
+        offset = 18 + data[0];
+        Image::Format format = data[16] == 24? Image::FORMAT_BGR8 : Image::FORMAT_BGRA8;
+        if (!validSize(width, height, Image::bytesPerPixel(format))) {
+            error = path + ": invalid image size";
+            return false;
+        }
+        int pitch = width * Image::bytesPerPixel(format);
+        if (data[17] & 0x20) // Top-down
+            image = Image((void *) (data + offset), width, height, pitch, format);
+        else
+            image = Image((void *) (data + offset + size_t(pitch) * (height - 1)), width, height, -pitch, format);
+        return true;
+    }
+
+    HeaderReader reader(data, mapSize);
+    string magic = reader.token();
+    if (magic == "P6" && type == TYPE_PPM) {
+        width = reader.number();
+        height = reader.number();
+        maxval = reader.number();
+        depth = 3;
+    } else if (magic == "P7" && type == TYPE_PAM) {
+        for (string t = reader.token(); t != "ENDHDR"; t = reader.token()) {
+            if (t.empty()) {
+                error = path + ": truncated header";
+                return false;
+            }
+            if (t == "WIDTH") width = reader.number();
+            else if (t == "HEIGHT") height = reader.number();
+            else if (t == "DEPTH") depth = reader.number();
+            else if (t == "MAXVAL") maxval = reader.number();
+            else if (t == "TUPLTYPE") reader.token();
+        }
+    } else {
+        error = path + ": not a " + (type == TYPE_PPM? "PPM" : "PAM") + " file";
+        return false;
+    }
+    offset = reader.position();
+
+    if (maxval != 255 || (depth != 1 && depth != 3 && depth != 4)) {
+        error = path + ": only 8-bit PPM and PAM files are supported";
+        return false;
+    }
+    Image::Format format = depth == 1? Image::FORMAT_R8 : depth == 3? Image::FORMAT_RGB8 : Image::FORMAT_RGBA8;
+    if (!validSize(width, height, depth)) {
+        error = path + ": invalid image size";
+        return false;
+    }
+    image = Image((void *) (data + offset), width, height, width * depth, format);
+    return true;
+}
+
+
+bool ImageFile::create(const string &path, Type type, int width, int height, Image::Format format) {
+    close();
+
+    if (!canStore(type, format)) {
+        error = path + ": the format of the image can't be stored in this file type";
+        return false;
+    }
+
+    int bpp = Image::bytesPerPixel(format);
+    string header;
+    char buffer[128];
+    switch (type) {
+        case TYPE_RAW:
+            break;
+        case TYPE_PPM:
+            snprintf(buffer, sizeof(buffer), "P6\n%d %d\n255\n", width, height);
+            header = buffer;
+            break;
+        case TYPE_PAM:
+            snprintf(buffer, sizeof(buffer), "P7\nWIDTH %d\nHEIGHT %d\nDEPTH %d\nMAXVAL 255\nTUPLTYPE %s\nENDHDR\n",
+                     width, height, bpp, bpp == 1? "GRAYSCALE" : bpp == 3? "RGB" : "RGB_ALPHA");
+            header = buffer;
+            break;
+        case TYPE_TGA: {
+            unsigned char tga[18] = {};
+            tga[2] = 2; // Uncompressed true color
+            writeShort(tga + 12, width);
+            writeShort(tga + 14, height);
+            tga[16] = (unsigned char) (8 * bpp);
+            tga[17] = (unsigned char) (0x20 | (bpp == 4? 8 : 0)); // Top-down, alpha bits
+            header.assign((const char *) tga, 18);
+            break;
+        }
+    }
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        error = path + ": " + strerror(errno);
+        return false;
+    }
+    mapSize = header.size() + size_t(width) * height * bpp;
+    if (ftruncate(fd, off_t(mapSize)) == 0)
+        map = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int mapError = errno;
+    ::close(fd);
+    if (map == nullptr || map == MAP_FAILED) {
+        map = nullptr;
+        error = path + ": " + strerror(mapError);
+        return false;
+    }
+
+    memcpy(map, header.data(), header.size());
+    image = Image((unsigned char *) map + header.size(), width, height, width * bpp, format);
+    return true;
+}
+
+
+void ImageFile::close() {
+    if (map != nullptr)
+        munmap(map, mapSize);
+    map = nullptr;
+    mapSize = 0;
+    image = Image();
+}
+
+
+Image ImageFile::getImage(Image::Format format) const {
+    assert(Image::bytesPerPixel(format) == Image::bytesPerPixel(image.format));
+    return Image(image.data, image.width, image.height, image.pitch, format);
+}
+
+
+bool ImageFile::typeOf(const string &path, Type &type) {
+    size_t dot = path.find_last_of('.');
+    if (dot == string::npos || path.find('/', dot) != string::npos)
+        return false;
+    string ext = path.substr(dot + 1);
+    for (auto &c : ext)
+        c = char(tolower((unsigned char) c));
+
+    if (ext == "raw") type = TYPE_RAW;
+    else if (ext == "ppm") type = TYPE_PPM;
+    else if (ext == "pam") type = TYPE_PAM;
+    else if (ext == "tga") type = TYPE_TGA;
+    else return false;
+    return true;
+}
+
+
+bool ImageFile::canStore(Type type, Image::Format format) {
+    switch (type) {
+        case TYPE_RAW: return true;
+        case TYPE_PPM: return format == Image::FORMAT_RGB8;
+        case TYPE_PAM: return format == Image::FORMAT_R8 || format == Image::FORMAT_RGB8 || format == Image::FORMAT_RGBA8;
+        case TYPE_TGA: return format == Image::FORMAT_BGR8 || format == Image::FORMAT_BGRA8;
+        default: return false;
+    }
+}
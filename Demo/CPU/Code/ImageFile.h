@@ -0,0 +1,107 @@
+/**
+ * Copyright (C) 2013 Jorge Jimenez (jorge@iryoku.com)
+ * Copyright (C) 2013 Jose I. Echevarria (joseignacioechevarria@gmail.com)
+ * Copyright (C) 2013 Belen Masia (bmasia@unizar.es)
+ * Copyright (C) 2013 Fernando Navarro (fernandn@microsoft.com)
+ * Copyright (C) 2013 Diego Gutierrez (diegog@unizar.es)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software. As clarification, there
+ * is no requirement that the copyright notice and permission be included in
+ * binary distributions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef IMAGEFILE_H
+#define IMAGEFILE_H
+
+#include <string>
+#include "Image.h"
+
+/**
+ * An image file mapped into memory. Only uncompressed formats are supported,
+ * so that the pixels are handed to SMAA right where they are in the file,
+ * without decoding nor copying:
+ *     TYPE_RAW: pixels only, with the size and format given by the caller.
+ *     TYPE_PPM: P6, FORMAT_RGB8.
+ *     TYPE_PAM: P7, FORMAT_R8, FORMAT_RGB8 and FORMAT_RGBA8 (TUPLTYPE
+ *               GRAYSCALE, RGB and RGB_ALPHA).
+ *     TYPE_TGA: uncompressed true color, FORMAT_BGR8 and FORMAT_BGRA8; images
+ *               stored bottom-up get a negative pitch.
+ * Netpbm files must have 8 bits per channel (MAXVAL 255).
+ *
+ * Output files are created with their final size and mapped as well, so that
+ * SMAA writes into the page cache directly.
+ */
+class ImageFile {
+    public:
+        enum Type { TYPE_RAW, TYPE_PPM, TYPE_PAM, TYPE_TGA };
+
+        ImageFile() : map(nullptr), mapSize(0) {}
+        ImageFile(const ImageFile &) = delete;
+        ImageFile &operator=(const ImageFile &) = delete;
+        ~ImageFile() { close(); }
+
+        /**
+         * Maps an existing file for reading. For TYPE_RAW, 'raw' gives the
+         * size and format (its data and pitch are ignored; rows are packed).
+         * Returns false on failure, see getError().
+         */
+        bool open(const std::string &path, const Image *raw=nullptr);
+
+        /**
+         * Creates (or truncates) a file of the given type and maps it for
+         * writing. The pixels are undefined until written through getImage().
+         */
+        bool create(const std::string &path, Type type, int width, int height, Image::Format format);
+
+        /**
+         * Unmaps the file; the pixels are written back by the system.
+         */
+        void close();
+
+        /**
+         * Returns a view of the pixels. 'format' can be one of the _SRGB
+         * variants of the format of the file.
+         */
+        Image getImage(Image::Format format) const;
+        Image getImage() const { return image; }
+
+        const std::string &getError() const { return error; }
+
+        /**
+         * Guesses the type from the extension of 'path' (.raw, .ppm, .pam or
+         * .tga). Returns false if it is none of them.
+         */
+        static bool typeOf(const std::string &path, Type &type);
+
+        /**
+         * Tells whether 'format' can be stored in a file of type 'type'.
+         */
+        static bool canStore(Type type, Image::Format format);
+
+    private:
+        bool parseHeader(const std::string &path, Type type);
+
+        void *map;
+        size_t mapSize;
+        Image image;
+        std::string error;
+};
+
+#endif
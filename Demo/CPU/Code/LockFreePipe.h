@@ -0,0 +1,341 @@
+/**
+ * Copyright (C) 2013 Jorge Jimenez (jorge@iryoku.com)
+ * Copyright (C) 2013 Jose I. Echevarria (joseignacioechevarria@gmail.com)
+ * Copyright (C) 2013 Belen Masia (bmasia@unizar.es)
+ * Copyright (C) 2013 Fernando Navarro (fernandn@microsoft.com)
+ * Copyright (C) 2013 Diego Gutierrez (diegog@unizar.es)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software. As clarification, there
+ * is no requirement that the copyright notice and permission be included in
+ * binary distributions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef LOCKFREEPIPE_H
+#define LOCKFREEPIPE_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+/**
+ * Portable versions of DXUTLockFreePipe (see Demo/DXUT/Optional), built on
+ * std::atomic instead of compiler barriers, plus a queue for more than two
+ * threads.
+ */
+
+
+/**
+ * Byte pipe for at most two threads: one reader, one writer. The size of the
+ * buffer is 2^SizeLog2 bytes; offsets are never clamped to it, and rely on
+ * wrapping around instead, as in the original.
+ *
+ * Reading the offset of the other side is an acquire, and publishing our own
+ * a release, so that the data copied before publishing is visible to the
+ * other thread once it sees the new offset. Several messages can be written
+ * (or read) with a single call, which publishes them all at once.
+ */
+template <int SizeLog2> class LockFreePipe {
+    public:
+        LockFreePipe() : readOffset(0), writeOffset(0) {}
+        LockFreePipe(const LockFreePipe &) = delete;
+        LockFreePipe &operator=(const LockFreePipe &) = delete;
+
+        size_t getBufferSize() const { return size; }
+
+        /**
+         * Bytes ready to be read. Only meaningful for the reader; for the
+         * writer, it's just a hint.
+         */
+        size_t bytesAvailable() const {
+            return writeOffset.load(std::memory_order_acquire) - readOffset.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * Reads exactly 'count' bytes, or nothing if there are not that many.
+         */
+        bool read(void *dest, size_t count) {
+            unsigned int r = readOffset.load(std::memory_order_relaxed);
+            unsigned int w = writeOffset.load(std::memory_order_acquire);
+            if (count > w - r)
+                return false;
+            copyOut(r, dest, count);
+            readOffset.store(r + (unsigned int) count, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * Reads whatever is available, up to 'count' bytes, and returns how
+         * much it was.
+         */
+        size_t readSome(void *dest, size_t count) {
+            unsigned int r = readOffset.load(std::memory_order_relaxed);
+            unsigned int w = writeOffset.load(std::memory_order_acquire);
+            count = std::min(count, size_t(w - r));
+            copyOut(r, dest, count);
+            readOffset.store(r + (unsigned int) count, std::memory_order_release);
+            return count;
+        }
+
+        /**
+         * Writes all the 'count' bytes, or nothing if they don't fit.
+         */
+        bool write(const void *src, size_t count) {
+            unsigned int w = writeOffset.load(std::memory_order_relaxed);
+            unsigned int r = readOffset.load(std::memory_order_acquire);
+            if (count > size - (w - r))
+                return false;
+            copyIn(w, src, count);
+            writeOffset.store(w + (unsigned int) count, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        static_assert(SizeLog2 > 0 && SizeLog2 < 31, "the pipe must be smaller than 2 GB");
+        static const unsigned int size = 1u << SizeLog2;
+        static const unsigned int mask = size - 1;
+
+        // Copies from the tail of the buffer, then from its head:
+        void copyOut(unsigned int offset, void *dest, size_t count) const {
+            size_t tail = std::min(count, size_t(size - (offset & mask)));
+            memcpy(dest, buffer + (offset & mask), tail);
+            memcpy((unsigned char *) dest + tail, buffer, count - tail);
+        }
+        void copyIn(unsigned int offset, const void *src, size_t count) {
+            size_t tail = std::min(count, size_t(size - (offset & mask)));
+            memcpy(buffer + (offset & mask), src, tail);
+            memcpy(buffer, (const unsigned char *) src + tail, count - tail);
+        }
+
+        unsigned char buffer[size];
+
+        // Each on its own cache line, so that the reader and the writer don't
+        // invalidate each other's line on every update:
+        alignas(64) std::atomic<unsigned int> readOffset;
+        alignas(64) std::atomic<unsigned int> writeOffset;
+};
+
+
+/**
+ * Same, for messages of type T instead of bytes, which are moved in and out
+ * rather than copied bytewise, so T can be any movable type (a FramePool
+ * handle, for example). Each side also keeps the last offset it saw from the
+ * other one, and only reads the shared one again when that is not enough,
+ * which saves most of the cache misses when the pipe is neither full nor
+ * empty.
+ */
+template <class T, int SizeLog2> class MessagePipe {
+    public:
+        MessagePipe() : items(new T[size]), readOffset(0), knownWrite(0), writeOffset(0), knownRead(0) {}
+        MessagePipe(const MessagePipe &) = delete;
+        MessagePipe &operator=(const MessagePipe &) = delete;
+
+        size_t getCapacity() const { return size; }
+
+        /**
+         * Returns false if the pipe is full (or empty, for pop).
+         */
+        bool push(T item) { return push(&item, 1) == 1; }
+        bool pop(T &item) { return pop(&item, 1) == 1; }
+
+        /**
+         * Pushes (or pops) as many of the 'count' items as possible, and
+         * returns how many, publishing them all at once.
+         */
+        size_t push(T *src, size_t count) {
+            unsigned int w = writeOffset.load(std::memory_order_relaxed);
+            if (count > size - (w - knownRead))
+                knownRead = readOffset.load(std::memory_order_acquire);
+            count = std::min(count, size_t(size - (w - knownRead)));
+            for (size_t i = 0; i < count; i++)
+                items[(w + i) & mask] = std::move(src[i]);
+            writeOffset.store(w + (unsigned int) count, std::memory_order_release);
+            return count;
+        }
+        size_t pop(T *dest, size_t count) {
+            unsigned int r = readOffset.load(std::memory_order_relaxed);
+            if (count > knownWrite - r)
+                knownWrite = writeOffset.load(std::memory_order_acquire);
+            count = std::min(count, size_t(knownWrite - r));
+            for (size_t i = 0; i < count; i++)
+                dest[i] = std::move(items[(r + i) & mask]);
+            readOffset.store(r + (unsigned int) count, std::memory_order_release);
+            return count;
+        }
+
+    private:
+        static_assert(SizeLog2 >= 0 && SizeLog2 < 31, "the pipe must hold less than 2^31 items");
+        static const unsigned int size = 1u << SizeLog2;
+        static const unsigned int mask = size - 1;
+
+        std::unique_ptr<T[]> items;
+
+        // The reader side, then the writer side, each on its own cache line:
+        alignas(64) std::atomic<unsigned int> readOffset;
+        unsigned int knownWrite;
+        alignas(64) std::atomic<unsigned int> writeOffset;
+        unsigned int knownRead;
+};
+
+
+/**
+ * Bounded queue for any number of producers and consumers, used to hand
+ * frames between the stages of a pipeline. Each slot carries a sequence
+ * number, which tells whether it is ready to be written or read for the
+ * current lap around the buffer, so that producers only contend on the tail
+ * and consumers on the head (see Dmitry Vyukov's bounded MPMC queue).
+ *
+ * tryPush and tryPop never block. push and pop wait on a condition variable
+ * while the queue is full or empty; the other side only takes the mutex to
+ * wake them up when somebody is actually waiting.
+ */
+template <class T> class ConcurrentQueue {
+    public:
+        /**
+         * 'capacity' is rounded up to a power of two.
+         */
+        ConcurrentQueue(size_t capacity) : head(0), tail(0), pushers(0), poppers(0) {
+            size_t size = 2;
+            while (size < capacity)
+                size *= 2;
+            mask = size - 1;
+            slots.reset(new Slot[size]);
+            for (size_t i = 0; i < size; i++)
+                slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        ConcurrentQueue(const ConcurrentQueue &) = delete;
+        ConcurrentQueue &operator=(const ConcurrentQueue &) = delete;
+
+        size_t getCapacity() const { return mask + 1; }
+
+        /**
+         * Returns false, leaving 'item' untouched, if the queue is full (or
+         * empty, for tryPop).
+         */
+        bool tryPush(T &item) {
+            if (!enqueue(item))
+                return false;
+            wake(poppers, notEmpty);
+            return true;
+        }
+
+        bool tryPop(T &item) {
+            if (!dequeue(item))
+                return false;
+            wake(pushers, notFull);
+            return true;
+        }
+
+        void push(T item) {
+            if (!enqueue(item))
+                wait(pushers, notFull, [&] { return enqueue(item); });
+            wake(poppers, notEmpty);
+        }
+
+        T pop() {
+            T item;
+            if (!dequeue(item))
+                wait(poppers, notEmpty, [&] { return dequeue(item); });
+            wake(pushers, notFull);
+            return item;
+        }
+
+    private:
+        struct Slot {
+            std::atomic<size_t> sequence;
+            T item;
+        };
+
+        bool enqueue(T &item) {
+            size_t position = tail.load(std::memory_order_relaxed);
+            Slot *slot;
+            for (;;) {
+                slot = &slots[position & mask];
+                ptrdiff_t lap = ptrdiff_t(slot->sequence.load(std::memory_order_acquire) - position);
+                if (lap == 0) {
+                    if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                        break;
+                } else if (lap < 0)
+                    return false; // Still holds the item of the previous lap.
+                else
+                    position = tail.load(std::memory_order_relaxed);
+            }
+            slot->item = std::move(item);
+            slot->sequence.store(position + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool dequeue(T &item) {
+            size_t position = head.load(std::memory_order_relaxed);
+            Slot *slot;
+            for (;;) {
+                slot = &slots[position & mask];
+                ptrdiff_t lap = ptrdiff_t(slot->sequence.load(std::memory_order_acquire) - (position + 1));
+                if (lap == 0) {
+                    if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                        break;
+                } else if (lap < 0)
+                    return false; // Not written yet.
+                else
+                    position = head.load(std::memory_order_relaxed);
+            }
+            item = std::move(slot->item);
+            slot->sequence.store(position + mask + 1, std::memory_order_release);
+            return true;
+        }
+
+        // The fences order registering as a waiter against checking the
+        // queue again, and publishing a slot against checking for waiters;
+        // so either the waiter sees the slot, or the other side sees it
+        // waiting, and notifies it under the mutex:
+        template <class Predicate>
+        void wait(std::atomic<int> &waiters, std::condition_variable &condition, Predicate predicate) {
+            waiters.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, predicate);
+            }
+            waiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        void wake(std::atomic<int> &waiters, std::condition_variable &condition) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (waiters.load(std::memory_order_relaxed) > 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                condition.notify_all();
+            }
+        }
+
+        std::unique_ptr<Slot[]> slots;
+        size_t mask;
+
+        alignas(64) std::atomic<size_t> head;
+        alignas(64) std::atomic<size_t> tail;
+
+        alignas(64) std::atomic<int> pushers, poppers;
+        std::mutex mutex;
+        std::condition_variable notEmpty, notFull;
+};
+
+#endif
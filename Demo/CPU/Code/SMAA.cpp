@@ -0,0 +1,3088 @@
+/**
+ * Copyright (C) 2013 Jorge Jimenez (jorge@iryoku.com)
+ * Copyright (C) 2013 Jose I. Echevarria (joseignacioechevarria@gmail.com)
+ * Copyright (C) 2013 Belen Masia (bmasia@unizar.es)
+ * Copyright (C) 2013 Fernando Navarro (fernandn@microsoft.com)
+ * Copyright (C) 2013 Diego Gutierrez (diegog@unizar.es)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software. As clarification, there
+ * is no requirement that the copyright notice and permission be included in
+ * binary distributions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <emmintrin.h>
+#include <limits>
+#include <mutex>
+#include <new>
+#if defined(__F16C__)
+#include <immintrin.h>
+#define SMAA_F16C
+#if defined(__AVX2__)
+#define SMAA_AVX2
+#endif
+#endif
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+#include "AreaTex.h"
+#include "SearchTex.h"
+#include "SMAA.h"
+using namespace std;
+
+
+// Non-configurable defines, see SMAA.hlsl:
+#define SMAA_LOCAL_CONTRAST_ADAPTATION_FACTOR 2.0f
+#define SMAA_PREDICATION_THRESHOLD 0.01f
+#define SMAA_PREDICATION_SCALE 2.0f
+#define SMAA_PREDICATION_STRENGTH 0.4f
+#define SMAA_AREATEX_MAX_DISTANCE 16
+#define SMAA_AREATEX_MAX_DISTANCE_DIAG 20
+#define SMAA_AREATEX_SUBTEX_HEIGHT (AREATEX_HEIGHT / 7)
+#define SMAA_REPROJECTION_WEIGHT_SCALE 30.0f
+
+// Number of rows each thread grabs at a time:
+#define SMAA_ROWS_PER_TASK 32
+
+// Padding of the scratch rows used in the edge detection, in floats:
+#define SMAA_ROW_PADDING 4
+
+// Number of plans kept for reuse, see @PLAN:
+#define SMAA_PLAN_CACHE_SIZE 16
+
+// Size of the tiles compared from frame to frame, see @TILE_CACHE:
+#define SMAA_TILE_SIZE 64
+
+// Alignment of the buffers carved from the arena, and of the arena itself
+// when backed by huge pages, see @EXTERNAL_STORAGE:
+#define SMAA_ARENA_ALIGNMENT 64
+#define SMAA_HUGE_PAGE_SIZE (2 << 20)
+
+
+/**
+ * The edge detection keeps a ring of four rows (three planes in the case of
+ * color edge detection) plus two for predication, per thread. This is their
+ * size in floats.
+ */
+static inline int scratchRowsSize(int width) {
+    return 14 * (width + 2 * SMAA_ROW_PADDING);
+}
+
+
+class SMAA::Parameters {
+    public:
+        float threshold;
+        int maxSearchSteps;
+        int maxSearchStepsDiag;
+        float cornerRounding;
+        bool diagDetection;
+        bool cornerDetection;
+};
+
+
+class SMAA::Plan {
+    public:
+        typedef void (*RowLoader)(const Image &src, int y, int sample, float *const out[3]);
+
+        Plan(int width, int height, Image::Format format, Preset preset, Input input, const Parameters &parameters);
+
+        bool matches(int width, int height, Image::Format format, Preset preset, Input input, const Parameters &parameters) const;
+
+        int width, height;
+        Image::Format format;
+        Preset preset;
+        Input input;
+        Parameters parameters;
+
+        // Row bands of the passes, and reach of the searches (see getHalo):
+        int tasks;
+        int halo;
+
+        // The edge detection keeps a ring of rows per thread, see
+        // edgesDetectionPass:
+        int stride, planes, scratchPerThread;
+        RowLoader loadRow;
+};
+
+
+/**
+ * How the neighborhood blending mixes a blended pixel, worked out once from
+ * its blending weights for all the auxiliary planes (see @PLANES). The
+ * direction of each subsample is 1 for horizontal, 0 for vertical, and -1
+ * when it is not blended.
+ */
+class SMAA::PlaneBlend {
+    public:
+        int x;
+        int direction[2];
+        float offset1[2], offset2[2];
+        float weight1[2], weight2[2];
+};
+
+
+//-----------------------------------------------------------------------------
+// Texture sampling emulation
+
+/**
+ * The shader heavily relies on bilinear filtering for fetching several edges
+ * at once. These classes emulate SampleLevelZero() with linear filtering and
+ * clamp addressing. Coordinates are given in pixels, rather than normalized
+ * texture coordinates, so texel centers lie at (x + 0.5, y + 0.5).
+ */
+class EdgesTexture {
+    public:
+        EdgesTexture(const unsigned char *data, int width, int height)
+            : data(data), width(width), height(height) {}
+
+        int load(int x, int y) const {
+            x = min(max(x, 0), width - 1);
+            y = min(max(y, 0), height - 1);
+            return data[y * width + x];
+        }
+
+        void sample(float x, float y, float &r, float &g) const {
+            x -= 0.5f;
+            y -= 0.5f;
+            float fx0 = floor(x), fy0 = floor(y);
+            float fx = x - fx0, fy = y - fy0;
+            int x0 = int(fx0), y0 = int(fy0);
+
+            int e00 = load(x0, y0),     e10 = load(x0 + 1, y0);
+            int e01 = load(x0, y0 + 1), e11 = load(x0 + 1, y0 + 1);
+
+            float w00 = (1.0f - fx) * (1.0f - fy), w10 = fx * (1.0f - fy);
+            float w01 = (1.0f - fx) * fy,          w11 = fx * fy;
+
+            r = w00 * (e00 & 1) + w10 * (e10 & 1) + w01 * (e01 & 1) + w11 * (e11 & 1);
+            g = w00 * (e00 >> 1) + w10 * (e10 >> 1) + w01 * (e01 >> 1) + w11 * (e11 >> 1);
+        }
+
+        float sampleR(float x, float y) const { float r, g; sample(x, y, r, g); return r; }
+        float sampleG(float x, float y) const { float r, g; sample(x, y, r, g); return g; }
+
+    private:
+        const unsigned char *data;
+        int width, height;
+};
+
+
+class LookupTexture {
+    public:
+        LookupTexture(const unsigned char *data, int width, int height, int channels)
+            : data(data), width(width), height(height), channels(channels) {}
+
+        float sample(float x, float y, int channel) const {
+            x -= 0.5f;
+            y -= 0.5f;
+            float fx0 = floor(x), fy0 = floor(y);
+            float fx = x - fx0, fy = y - fy0;
+            int x0 = int(fx0), y0 = int(fy0);
+
+            float t00 = load(x0, y0, channel),     t10 = load(x0 + 1, y0, channel);
+            float t01 = load(x0, y0 + 1, channel), t11 = load(x0 + 1, y0 + 1, channel);
+
+            float top = t00 + fx * (t10 - t00);
+            float bottom = t01 + fx * (t11 - t01);
+            return (top + fy * (bottom - top)) * (1.0f / 255.0f);
+        }
+
+    private:
+        float load(int x, int y, int channel) const {
+            x = min(max(x, 0), width - 1);
+            y = min(max(y, 0), height - 1);
+            return float(data[(y * width + x) * channels + channel]);
+        }
+
+        const unsigned char *data;
+        int width, height, channels;
+};
+
+static const LookupTexture standardAreaTex(areaTexBytes, AREATEX_WIDTH, AREATEX_HEIGHT, 2);
+static const LookupTexture searchTex(searchTexBytes, SEARCHTEX_WIDTH, SEARCHTEX_HEIGHT, 1);
+
+
+//-----------------------------------------------------------------------------
+// Blending weight calculation (second pass)
+
+/**
+ * This is a line-by-line port of SMAABlendingWeightCalculationPS and the
+ * functions it calls; look there for the details.
+ */
+class BlendingWeightCalculation {
+    public:
+        BlendingWeightCalculation(const EdgesTexture &edgesTex, const LookupTexture &areaTex, const float subsampleIndices[4],
+                                  int maxSearchSteps, int maxSearchStepsDiag, float cornerRounding,
+                                  bool diagDetection, bool cornerDetection)
+            : edgesTex(edgesTex),
+              areaTex(areaTex),
+              maxSearchSteps(maxSearchSteps),
+              maxSearchStepsDiag(maxSearchStepsDiag),
+              cornerRoundingNorm(cornerRounding / 100.0f),
+              diagDetection(diagDetection),
+              cornerDetection(cornerDetection) {
+            for (int i = 0; i < 4; i++)
+                this->subsampleIndices[i] = subsampleIndices[i];
+        }
+
+        void go(int x, int y, int e, float weights[4]) const;
+
+    private:
+        static void decodeDiagBilinearAccess(float &r, float &g) {
+            r = r * abs(5.0f * r - 5.0f * 0.75f);
+            r = round(r);
+            g = round(g);
+        }
+
+        void searchDiag1(float x, float y, float dx, float dy, float &d, float &found, float &endG) const;
+        void searchDiag2(float x, float y, float dx, float dy, float &d, float &found, float &endG) const;
+        void areaDiag(float d1, float d2, float e1, float e2, float offset, float &w1, float &w2) const;
+        void calculateDiagWeights(float x, float y, float er, float weights[2]) const;
+
+        float searchLength(float e1, float e2, float offset) const;
+        float searchXLeft(float x, float y, float end) const;
+        float searchXRight(float x, float y, float end) const;
+        float searchYUp(float x, float y, float end) const;
+        float searchYDown(float x, float y, float end) const;
+        void area(float d1, float d2, float e1, float e2, float offset, float &w1, float &w2) const;
+
+        void detectHorizontalCornerPattern(float weights[2], float left, float right, float y, float d1, float d2) const;
+        void detectVerticalCornerPattern(float weights[2], float x, float top, float bottom, float d1, float d2) const;
+
+        const EdgesTexture &edgesTex;
+        const LookupTexture &areaTex;
+        float subsampleIndices[4];
+        int maxSearchSteps, maxSearchStepsDiag;
+        float cornerRoundingNorm;
+        bool diagDetection, cornerDetection;
+};
+
+
+void BlendingWeightCalculation::searchDiag1(float x, float y, float dx, float dy, float &d, float &found, float &endG) const {
+    float z = -1.0f, w = 1.0f;
+    while (z < float(maxSearchStepsDiag - 1) && w > 0.9f) {
+        x += dx;
+        y += dy;
+        z += 1.0f;
+        float r, g;
+        edgesTex.sample(x, y, r, g);
+        w = 0.5f * (r + g);
+        endG = g;
+    }
+    d = z;
+    found = w;
+}
+
+
+void BlendingWeightCalculation::searchDiag2(float x, float y, float dx, float dy, float &d, float &found, float &endG) const {
+    float z = -1.0f, w = 1.0f;
+    x += 0.25f; // See @SearchDiag2Optimization
+    while (z < float(maxSearchStepsDiag - 1) && w > 0.9f) {
+        x += dx;
+        y += dy;
+        z += 1.0f;
+
+        // Fetch both edges at once using bilinear filtering:
+        float r, g;
+        edgesTex.sample(x, y, r, g);
+        decodeDiagBilinearAccess(r, g);
+
+        w = 0.5f * (r + g);
+        endG = g;
+    }
+    d = z;
+    found = w;
+}
+
+
+void BlendingWeightCalculation::areaDiag(float d1, float d2, float e1, float e2, float offset, float &w1, float &w2) const {
+    float x = float(SMAA_AREATEX_MAX_DISTANCE_DIAG) * e1 + d1;
+    float y = float(SMAA_AREATEX_MAX_DISTANCE_DIAG) * e2 + d2;
+
+    // Diagonal areas are on the second half of the texture:
+    x += 0.5f * AREATEX_WIDTH;
+
+    // Move to proper place, according to the subpixel offset:
+    y += SMAA_AREATEX_SUBTEX_HEIGHT * offset;
+
+    // Do it! (texel centers are at +0.5)
+    w1 = areaTex.sample(x + 0.5f, y + 0.5f, 0);
+    w2 = areaTex.sample(x + 0.5f, y + 0.5f, 1);
+}
+
+
+void BlendingWeightCalculation::calculateDiagWeights(float x, float y, float er, float weights[2]) const {
+    weights[0] = weights[1] = 0.0f;
+
+    // Search for the line ends:
+    float d[4], end = 0.0f;
+    if (er > 0.0f) {
+        searchDiag1(x, y, -1.0f, 1.0f, d[0], d[2], end);
+        d[0] += float(end > 0.9f);
+    } else
+        d[0] = d[2] = 0.0f;
+    searchDiag1(x, y, 1.0f, -1.0f, d[1], d[3], end);
+
+    if (d[0] + d[1] > 2.0f) { // d.x + d.y + 1 > 3
+        // Fetch the crossing edges:
+        float c[4];
+        edgesTex.sample(x - d[0] + 0.25f - 1.0f, y + d[0], c[0], c[1]);
+        edgesTex.sample(x + d[1] + 1.0f, y - d[1] - 0.25f, c[2], c[3]);
+        decodeDiagBilinearAccess(c[0], c[1]);
+        decodeDiagBilinearAccess(c[2], c[3]);
+        swap(c[0], c[1]); // c.yxwz = SMAADecodeDiagBilinearAccess(c.xyzw)
+        swap(c[2], c[3]);
+
+        // Merge crossing edges at each side into a single value:
+        float cc[2] = { 2.0f * c[0] + c[1], 2.0f * c[2] + c[3] };
+
+        // Remove the crossing edge if we didn't found the end of the line:
+        if (d[2] >= 0.9f) cc[0] = 0.0f;
+        if (d[3] >= 0.9f) cc[1] = 0.0f;
+
+        // Fetch the areas for this line:
+        float w1, w2;
+        areaDiag(d[0], d[1], cc[0], cc[1], subsampleIndices[2], w1, w2);
+        weights[0] += w1;
+        weights[1] += w2;
+    }
+
+    // Search for the line ends:
+    searchDiag2(x, y, -1.0f, -1.0f, d[0], d[2], end);
+    if (edgesTex.sampleR(x + 1.0f, y) > 0.0f) {
+        searchDiag2(x, y, 1.0f, 1.0f, d[1], d[3], end);
+        d[1] += float(end > 0.9f);
+    } else
+        d[1] = d[3] = 0.0f;
+
+    if (d[0] + d[1] > 2.0f) { // d.x + d.y + 1 > 3
+        // Fetch the crossing edges:
+        float c[4];
+        c[0] = edgesTex.sampleG(x - d[0] - 1.0f, y - d[0]);
+        c[1] = edgesTex.sampleR(x - d[0], y - d[0] - 1.0f);
+        edgesTex.sample(x + d[1] + 1.0f, y + d[1], c[3], c[2]);
+        float cc[2] = { 2.0f * c[0] + c[1], 2.0f * c[2] + c[3] };
+
+        // Remove the crossing edge if we didn't found the end of the line:
+        if (d[2] >= 0.9f) cc[0] = 0.0f;
+        if (d[3] >= 0.9f) cc[1] = 0.0f;
+
+        // Fetch the areas for this line:
+        float w1, w2;
+        areaDiag(d[0], d[1], cc[0], cc[1], subsampleIndices[3], w1, w2);
+        weights[0] += w2;
+        weights[1] += w1;
+    }
+}
+
+
+float BlendingWeightCalculation::searchLength(float e1, float e2, float offset) const {
+    // The texture is flipped vertically, with left and right cases taking half
+    // of the space horizontally (these are SMAASearchLength scale and bias,
+    // already in texels of the cropped texture):
+    float x = 32.0f * e1 + 66.0f * offset + 0.5f;
+    float y = -32.0f * e2 + 32.5f;
+    return searchTex.sample(x, y, 0);
+}
+
+
+float BlendingWeightCalculation::searchXLeft(float x, float y, float end) const {
+    // See @PSEUDO_GATHER4 in the shader:
+    float r = 0.0f, g = 1.0f;
+    while (x > end &&
+           g > 0.8281f && // Is there some edge not activated?
+           r == 0.0f) { // Or is there a crossing edge that breaks the line?
+        edgesTex.sample(x, y, r, g);
+        x -= 2.0f;
+    }
+    float offset = -(255.0f / 127.0f) * searchLength(r, g, 0.0f) + 3.25f;
+    return x + offset;
+}
+
+
+float BlendingWeightCalculation::searchXRight(float x, float y, float end) const {
+    float r = 0.0f, g = 1.0f;
+    while (x < end &&
+           g > 0.8281f && // Is there some edge not activated?
+           r == 0.0f) { // Or is there a crossing edge that breaks the line?
+        edgesTex.sample(x, y, r, g);
+        x += 2.0f;
+    }
+    float offset = -(255.0f / 127.0f) * searchLength(r, g, 0.5f) + 3.25f;
+    return x - offset;
+}
+
+
+float BlendingWeightCalculation::searchYUp(float x, float y, float end) const {
+    float r = 1.0f, g = 0.0f;
+    while (y > end &&
+           r > 0.8281f && // Is there some edge not activated?
+           g == 0.0f) { // Or is there a crossing edge that breaks the line?
+        edgesTex.sample(x, y, r, g);
+        y -= 2.0f;
+    }
+    float offset = -(255.0f / 127.0f) * searchLength(g, r, 0.0f) + 3.25f;
+    return y + offset;
+}
+
+
+float BlendingWeightCalculation::searchYDown(float x, float y, float end) const {
+    float r = 1.0f, g = 0.0f;
+    while (y < end &&
+           r > 0.8281f && // Is there some edge not activated?
+           g == 0.0f) { // Or is there a crossing edge that breaks the line?
+        edgesTex.sample(x, y, r, g);
+        y += 2.0f;
+    }
+    float offset = -(255.0f / 127.0f) * searchLength(g, r, 0.5f) + 3.25f;
+    return y - offset;
+}
+
+
+void BlendingWeightCalculation::area(float d1, float d2, float e1, float e2, float offset, float &w1, float &w2) const {
+    // Rounding prevents precision errors of bilinear filtering:
+    float x = float(SMAA_AREATEX_MAX_DISTANCE) * round(4.0f * e1) + d1;
+    float y = float(SMAA_AREATEX_MAX_DISTANCE) * round(4.0f * e2) + d2;
+
+    // Move to proper place, according to the subpixel offset:
+    y += SMAA_AREATEX_SUBTEX_HEIGHT * offset;
+
+    // Do it! (texel centers are at +0.5)
+    w1 = areaTex.sample(x + 0.5f, y + 0.5f, 0);
+    w2 = areaTex.sample(x + 0.5f, y + 0.5f, 1);
+}
+
+
+void BlendingWeightCalculation::detectHorizontalCornerPattern(float weights[2], float left, float right, float y, float d1, float d2) const {
+    if (!cornerDetection)
+        return;
+
+    float leftRight[2] = { float(d1 <= d2), float(d2 <= d1) };
+    float rounding[2] = { (1.0f - cornerRoundingNorm) * leftRight[0], (1.0f - cornerRoundingNorm) * leftRight[1] };
+
+    // Reduce blending for pixels in the center of a line:
+    rounding[0] /= leftRight[0] + leftRight[1];
+    rounding[1] /= leftRight[0] + leftRight[1];
+
+    float factor[2] = { 1.0f, 1.0f };
+    factor[0] -= rounding[0] * edgesTex.sampleR(left, y + 1.0f);
+    factor[0] -= rounding[1] * edgesTex.sampleR(right + 1.0f, y + 1.0f);
+    factor[1] -= rounding[0] * edgesTex.sampleR(left, y - 2.0f);
+    factor[1] -= rounding[1] * edgesTex.sampleR(right + 1.0f, y - 2.0f);
+
+    weights[0] *= min(max(factor[0], 0.0f), 1.0f);
+    weights[1] *= min(max(factor[1], 0.0f), 1.0f);
+}
+
+
+void BlendingWeightCalculation::detectVerticalCornerPattern(float weights[2], float x, float top, float bottom, float d1, float d2) const {
+    if (!cornerDetection)
+        return;
+
+    float leftRight[2] = { float(d1 <= d2), float(d2 <= d1) };
+    float rounding[2] = { (1.0f - cornerRoundingNorm) * leftRight[0], (1.0f - cornerRoundingNorm) * leftRight[1] };
+
+    rounding[0] /= leftRight[0] + leftRight[1];
+    rounding[1] /= leftRight[0] + leftRight[1];
+
+    float factor[2] = { 1.0f, 1.0f };
+    factor[0] -= rounding[0] * edgesTex.sampleG(x + 1.0f, top);
+    factor[0] -= rounding[1] * edgesTex.sampleG(x + 1.0f, bottom + 1.0f);
+    factor[1] -= rounding[0] * edgesTex.sampleG(x - 2.0f, top);
+    factor[1] -= rounding[1] * edgesTex.sampleG(x - 2.0f, bottom + 1.0f);
+
+    weights[0] *= min(max(factor[0], 0.0f), 1.0f);
+    weights[1] *= min(max(factor[1], 0.0f), 1.0f);
+}
+
+
+void BlendingWeightCalculation::go(int px, int py, int e, float weights[4]) const {
+    weights[0] = weights[1] = weights[2] = weights[3] = 0.0f;
+
+    // Pixel coordinates of the texel center (texcoord * SMAA_RT_METRICS.zw):
+    float x = float(px) + 0.5f;
+    float y = float(py) + 0.5f;
+
+    // These are the offsets of SMAABlendingWeightCalculationVS:
+    float offset[3][4] = {
+        { x - 0.25f,  y - 0.125f, x + 1.25f,  y - 0.125f },
+        { x - 0.125f, y - 0.25f,  x - 0.125f, y + 1.25f  },
+    };
+    offset[2][0] = offset[0][0] - 2.0f * float(maxSearchSteps);
+    offset[2][1] = offset[0][2] + 2.0f * float(maxSearchSteps);
+    offset[2][2] = offset[1][1] - 2.0f * float(maxSearchSteps);
+    offset[2][3] = offset[1][3] + 2.0f * float(maxSearchSteps);
+
+    bool er = (e & 1) != 0, eg = (e & 2) != 0;
+
+    if (eg) { // Edge at north
+        bool orthogonal = true;
+        if (diagDetection) {
+            // Diagonals have both north and west edges, so searching for them in
+            // one of the boundaries is enough.
+            calculateDiagWeights(x, y, float(er), weights);
+
+            // We give priority to diagonals, so if we find a diagonal we skip
+            // horizontal/vertical processing.
+            orthogonal = weights[0] == -weights[1]; // weights.r + weights.g == 0.0
+        }
+
+        if (orthogonal) {
+            float d[2];
+
+            // Find the distance to the left:
+            float coords[3];
+            coords[0] = searchXLeft(offset[0][0], offset[0][1], offset[2][0]);
+            coords[1] = offset[1][1]; // offset[1].y = y - 0.25 (@CROSSING_OFFSET)
+            d[0] = coords[0];
+
+            // Now fetch the left crossing edges, two at a time using bilinear
+            // filtering. Sampling at -0.25 (see @CROSSING_OFFSET) enables to
+            // discern what value each edge has:
+            float e1 = edgesTex.sampleR(coords[0], coords[1]);
+
+            // Find the distance to the right:
+            coords[2] = searchXRight(offset[0][2], offset[0][3], offset[2][1]);
+            d[1] = coords[2];
+
+            // We want the distances to be in pixel units:
+            d[0] = abs(round(d[0] - x));
+            d[1] = abs(round(d[1] - x));
+
+            // SMAAArea below needs a sqrt, as the areas texture is compressed
+            // quadratically:
+            float sqrt_d[2] = { sqrt(d[0]), sqrt(d[1]) };
+
+            // Fetch the right crossing edges:
+            float e2 = edgesTex.sampleR(coords[2] + 1.0f, coords[1]);
+
+            // Ok, we know how this pattern looks like, now it is time for getting
+            // the actual area:
+            area(sqrt_d[0], sqrt_d[1], e1, e2, subsampleIndices[1], weights[0], weights[1]);
+
+            // Fix corners:
+            detectHorizontalCornerPattern(weights, coords[0], coords[2], y, d[0], d[1]);
+        } else
+            er = false; // Skip vertical processing.
+    }
+
+    if (er) { // Edge at west
+        float d[2];
+
+        // Find the distance to the top:
+        float coords[3];
+        coords[1] = searchYUp(offset[1][0], offset[1][1], offset[2][2]);
+        coords[0] = offset[0][0]; // offset[0].x = x - 0.25
+        d[0] = coords[1];
+
+        // Fetch the top crossing edges:
+        float e1 = edgesTex.sampleG(coords[0], coords[1]);
+
+        // Find the distance to the bottom:
+        coords[2] = searchYDown(offset[1][2], offset[1][3], offset[2][3]);
+        d[1] = coords[2];
+
+        // We want the distances to be in pixel units:
+        d[0] = abs(round(d[0] - y));
+        d[1] = abs(round(d[1] - y));
+
+        // SMAAArea below needs a sqrt, as the areas texture is compressed
+        // quadratically:
+        float sqrt_d[2] = { sqrt(d[0]), sqrt(d[1]) };
+
+        // Fetch the bottom crossing edges:
+        float e2 = edgesTex.sampleG(coords[0], coords[2] + 1.0f);
+
+        // Get the area for this direction:
+        area(sqrt_d[0], sqrt_d[1], e1, e2, subsampleIndices[0], weights[2], weights[3]);
+
+        // Fix corners:
+        detectVerticalCornerPattern(weights + 2, x, coords[1], coords[2], d[0], d[1]);
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+// SIMD helpers
+
+/**
+ * Packs four floats in [0, 1] into R8G8B8A8_UNORM, rounding to nearest and
+ * saturating, exactly as the GPU does when writing to |blendTex|.
+ */
+static inline unsigned int packUnorm8(__m128 v) {
+    __m128i i = _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(255.0f)));
+    i = _mm_packs_epi32(i, i);
+    i = _mm_packus_epi16(i, i);
+    return (unsigned int) _mm_cvtsi128_si32(i);
+}
+
+/**
+ * Unpacks a R8G8B8A8 value into four floats in [0, 255].
+ */
+static inline __m128 unpack8(unsigned int v) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i i = _mm_cvtsi32_si128(int(v));
+    i = _mm_unpacklo_epi8(i, zero);
+    i = _mm_unpacklo_epi16(i, zero);
+    return _mm_cvtepi32_ps(i);
+}
+
+/**
+ * Packs four floats in [0, 255] into a R8G8B8A8 value.
+ */
+static inline unsigned int pack8(__m128 v) {
+    __m128i i = _mm_cvtps_epi32(v);
+    i = _mm_packs_epi32(i, i);
+    i = _mm_packus_epi16(i, i);
+    return (unsigned int) _mm_cvtsi128_si32(i);
+}
+
+static inline __m128 abs_ps(__m128 v) {
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+}
+
+/**
+ * Converts four half floats, stored in the low 16 bits of each lane, into
+ * floats (the upper bits must be zero). Denormals are handled by the final
+ * multiplication.
+ */
+static inline __m128 halfToFloat(__m128i h) {
+    __m128i expmant = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+    __m128i sign = _mm_slli_epi32(_mm_xor_si128(h, expmant), 16);
+    __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expmant, 13)),
+                               _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+    __m128i infnan = _mm_cmpgt_epi32(expmant, _mm_set1_epi32(0x7bff));
+    __m128 infnanExp = _mm_and_ps(_mm_castsi128_ps(infnan), _mm_castsi128_ps(_mm_set1_epi32(255 << 23)));
+    return _mm_or_ps(scaled, _mm_or_ps(_mm_castsi128_ps(sign), infnanExp));
+}
+
+static inline float halfToFloat(unsigned short h) {
+    return _mm_cvtss_f32(halfToFloat(_mm_cvtsi32_si128(h)));
+}
+
+/**
+ * Packs velocity into the alpha channel, as SMAANeighborhoodBlendingPS does
+ * for reprojection. Returns it in [0, 255], already rounded.
+ */
+static inline __m128i packVelocity(__m128 vx, __m128 vy) {
+    __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)));
+    __m128 a = _mm_min_ps(_mm_sqrt_ps(_mm_mul_ps(_mm_set1_ps(5.0f), length)), _mm_set1_ps(1.0f));
+    return _mm_cvtps_epi32(_mm_mul_ps(a, _mm_set1_ps(255.0f)));
+}
+
+static inline unsigned int packVelocity(float vx, float vy) {
+    return (unsigned int) _mm_cvtsi128_si32(packVelocity(_mm_set_ss(vx), _mm_set_ss(vy)));
+}
+
+/**
+ * Averages two R8G8B8A8 values, rounding as _mm_avg_epu8 does.
+ */
+static inline unsigned int average8(unsigned int a, unsigned int b) {
+    return (a | b) - (((a ^ b) >> 1) & 0x7f7f7f7f);
+}
+
+/**
+ * Stores the edges of four pixels, given the masks for the left and top ones.
+ */
+static inline void storeEdges(unsigned char *out, __m128 left, __m128 top, int count) {
+    int l = _mm_movemask_ps(left), t = _mm_movemask_ps(top);
+    for (int i = 0; i < count; i++)
+        out[i] = (unsigned char) (((l >> i) & 1) | (((t >> i) & 1) << 1));
+}
+
+
+/**
+ * Drops the edges of a group of pixels that touch a masked pixel (see
+ * @MASK): the left edge if either the pixel or its left neighbor is masked,
+ * and the top one likewise. 'mask' points to the first pixel of the group,
+ * and 'maskTop' to the one above, or is nullptr on the first row.
+ */
+static inline void maskEdges(unsigned char *out, const unsigned char *mask, const unsigned char *maskTop, bool first, int count) {
+    for (int i = 0; i < count; i++) {
+        if (mask[i] || ((i > 0 || !first) && mask[i - 1]))
+            out[i] &= ~1;
+        if (mask[i] || (maskTop != nullptr && maskTop[i]))
+            out[i] &= ~2;
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+// Color formats
+
+/**
+ * Loads four pixels of one of the subsamples of the input, given a pointer
+ * to the first one. For 2x multisampled images, this deinterleaves the
+ * subsamples on the fly, so that they don't need to be separated.
+ */
+static inline __m128i loadPixels(const unsigned char *in, int samples, int sample) {
+    if (samples == 1)
+        return _mm_loadu_si128((const __m128i *) in);
+
+    __m128 a = _mm_loadu_ps((const float *) in);
+    __m128 b = _mm_loadu_ps((const float *) (in + 16));
+    if (sample == 0)
+        return _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+    else
+        return _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+
+/**
+ * Converts four half floats, stored in the low 64 bits, into floats.
+ */
+static inline __m128 unpackHalf4(__m128i h) {
+    #ifdef SMAA_F16C
+    return _mm_cvtph_ps(h);
+    #else
+    return halfToFloat(_mm_unpacklo_epi16(h, _mm_setzero_si128()));
+    #endif
+}
+
+/**
+ * Converts a float into a half float, rounding to nearest even. See:
+ * https://gist.github.com/rygorous/2156668 (float_to_half_fast3_rtne)
+ */
+static inline unsigned short floatToHalf(float f) {
+    const unsigned int denormMagic = ((127 - 15) + (23 - 10) + 1) << 23;
+    unsigned int x;
+    memcpy(&x, &f, 4);
+    unsigned int sign = x & 0x80000000;
+    x ^= sign;
+
+    unsigned int h;
+    if (x >= 0x47800000) // Overflow, infinity or NaN
+        h = x > 0x7f800000? 0x7e00 : 0x7c00;
+    else if (x < 0x38800000) { // Denormal or zero
+        // Let the addition do the shifting and rounding:
+        float magic;
+        memcpy(&magic, &denormMagic, 4);
+        memcpy(&f, &x, 4);
+        f += magic;
+        memcpy(&h, &f, 4);
+        h -= denormMagic;
+    } else {
+        unsigned int odd = (x >> 13) & 1;
+        h = (x + ((15u - 127u) << 23) + 0xfff + odd) >> 13;
+    }
+    return (unsigned short) (h | (sign >> 16));
+}
+
+/**
+ * Converts four floats into half floats, returned in the low 64 bits.
+ */
+static inline __m128i packHalf4(__m128 v) {
+    #ifdef SMAA_F16C
+    return _mm_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT);
+    #else
+    alignas(16) float f[4];
+    _mm_store_ps(f, v);
+    return _mm_setr_epi16(short(floatToHalf(f[0])), short(floatToHalf(f[1])), short(floatToHalf(f[2])), short(floatToHalf(f[3])), 0, 0, 0, 0);
+    #endif
+}
+
+
+/**
+ * Each color format has a Pixel class, which the edge detection and
+ * neighborhood blending are instantiated with (see withPixel). A pixel is
+ * handled as a Value in the layout of the format, so that copying and
+ * averaging are done without unpacking, and the few pixels that are actually
+ * blended are unpacked to floats:
+ *     rgb: red, green and blue of four pixels for edge detection, in [0, 1]
+ *          (linear for the 'linear' formats), deinterleaving one of the
+ *          subsamples.
+ *     averageSamples: averages the two subsamples of four pixels.
+ *     load/store: one pixel.
+ *     unpack/pack: one pixel to and from floats, for blending.
+ *     average: per channel average, rounding up as _mm_avg_epu8.
+ */
+template <Image::Format format> class Pixel;
+
+template <class P> class Pixel8 {
+    public:
+        typedef unsigned int Value;
+        static const int size = 4;
+        static const bool linear = false;
+
+        static __m128i load4(const unsigned char *in, int samples, int sample) { return loadPixels(in, samples, sample); }
+        static void store4(unsigned char *out, __m128i p) { _mm_storeu_si128((__m128i *) out, p); }
+        static Value load(const unsigned char *in) { Value v; memcpy(&v, in, 4); return v; }
+        static void store(unsigned char *out, Value v) { memcpy(out, &v, 4); }
+
+        static void rgb(const unsigned char *in, int samples, int sample, __m128 &r, __m128 &g, __m128 &b) {
+            const __m128i mask = _mm_set1_epi32(0xff);
+            const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+            __m128i p = P::load4(in, samples, sample);
+            r = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(p, mask)), scale);
+            g = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 8), mask)), scale);
+            b = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 16), mask)), scale);
+        }
+
+        static void averageSamples(const unsigned char *in, unsigned char *out) {
+            P::store4(out, _mm_avg_epu8(P::load4(in, 2, 0), P::load4(in, 2, 1)));
+        }
+
+        static __m128 unpack(Value v) { return unpack8(v); }
+        static Value pack(__m128 v) { return pack8(v); }
+        static Value average(Value a, Value b) { return average8(a, b); }
+};
+
+template <> class Pixel<Image::FORMAT_RGBA8> : public Pixel8<Pixel<Image::FORMAT_RGBA8> > {};
+
+// The blending is the same for all channels, so only the edge detection needs
+// to know where the red is:
+template <> class Pixel<Image::FORMAT_BGRA8> : public Pixel8<Pixel<Image::FORMAT_BGRA8> > {
+    public:
+        static void rgb(const unsigned char *in, int samples, int sample, __m128 &r, __m128 &g, __m128 &b) {
+            Pixel8::rgb(in, samples, sample, b, g, r);
+        }
+};
+
+// The fourth byte is blended along, there is no need to mask it:
+template <> class Pixel<Image::FORMAT_RGBX8> : public Pixel8<Pixel<Image::FORMAT_RGBX8> > {};
+
+// Pixels are expanded to RGBA lanes, with an opaque alpha:
+template <> class Pixel<Image::FORMAT_RGB8> : public Pixel8<Pixel<Image::FORMAT_RGB8> > {
+    public:
+        static const int size = 3;
+
+        static __m128i load4(const unsigned char *in, int samples, int sample) {
+            if (samples == 1)
+                return expand(in);
+
+            __m128 a = _mm_castsi128_ps(expand(in));
+            __m128 b = _mm_castsi128_ps(expand(in + 12));
+            if (sample == 0)
+                return _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            else
+                return _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+
+        static void store4(unsigned char *out, __m128i p) {
+            // Join each pair of pixels into 48 bits, and then the two pairs:
+            p = _mm_and_si128(p, _mm_set1_epi32(0x00ffffff));
+            p = _mm_or_si128(_mm_and_si128(p, _mm_set_epi32(0, -1, 0, -1)), _mm_slli_epi64(_mm_srli_epi64(p, 32), 24));
+            p = _mm_or_si128(_mm_and_si128(p, _mm_set_epi32(0, 0, 0xffff, -1)), _mm_slli_si128(_mm_srli_si128(p, 8), 6));
+            _mm_storel_epi64((__m128i *) out, p);
+            int last = _mm_cvtsi128_si32(_mm_srli_si128(p, 8));
+            memcpy(out + 8, &last, 4);
+        }
+
+        static Value load(const unsigned char *in) {
+            return in[0] | (in[1] << 8) | (in[2] << 16) | 0xff000000;
+        }
+
+        static void store(unsigned char *out, Value v) {
+            out[0] = (unsigned char) v;
+            out[1] = (unsigned char) (v >> 8);
+            out[2] = (unsigned char) (v >> 16);
+        }
+
+    private:
+        // Reads exactly 12 bytes, as the last pixels of a row may be at the
+        // end of the buffer:
+        static __m128i expand(const unsigned char *in) {
+            int last;
+            memcpy(&last, in + 8, 4);
+            __m128i v = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) in), _mm_cvtsi32_si128(last));
+            __m128i p01 = _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3));
+            __m128i p23 = _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9));
+            __m128i p = _mm_unpacklo_epi64(p01, p23);
+            return _mm_or_si128(p, _mm_set1_epi32(0xff000000));
+        }
+};
+
+template <> class Pixel<Image::FORMAT_BGR8> : public Pixel<Image::FORMAT_RGB8> {
+    public:
+        static void rgb(const unsigned char *in, int samples, int sample, __m128 &r, __m128 &g, __m128 &b) {
+            Pixel<Image::FORMAT_RGB8>::rgb(in, samples, sample, b, g, r);
+        }
+};
+
+// Channels are unpacked to [0, 1023] (and alpha to [0, 3]) for blending, so
+// that no precision is lost:
+template <> class Pixel<Image::FORMAT_RGB10A2> {
+    public:
+        typedef unsigned int Value;
+        static const int size = 4;
+        static const bool linear = false;
+
+        static Value load(const unsigned char *in) { Value v; memcpy(&v, in, 4); return v; }
+        static void store(unsigned char *out, Value v) { memcpy(out, &v, 4); }
+
+        static void rgb(const unsigned char *in, int samples, int sample, __m128 &r, __m128 &g, __m128 &b) {
+            const __m128i mask = _mm_set1_epi32(0x3ff);
+            const __m128 scale = _mm_set1_ps(1.0f / 1023.0f);
+            __m128i p = loadPixels(in, samples, sample);
+            r = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(p, mask)), scale);
+            g = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 10), mask)), scale);
+            b = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 20), mask)), scale);
+        }
+
+        static void averageSamples(const unsigned char *in, unsigned char *out) {
+            _mm_storeu_si128((__m128i *) out, average(loadPixels(in, 2, 0), loadPixels(in, 2, 1)));
+        }
+
+        static __m128 unpack(Value v) {
+            return _mm_setr_ps(float(v & 0x3ff), float((v >> 10) & 0x3ff), float((v >> 20) & 0x3ff), float(v >> 30));
+        }
+
+        static Value pack(__m128 v) {
+            v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_setr_ps(1023.0f, 1023.0f, 1023.0f, 3.0f));
+            alignas(16) int c[4];
+            _mm_store_si128((__m128i *) c, _mm_cvtps_epi32(v));
+            return unsigned(c[0]) | (unsigned(c[1]) << 10) | (unsigned(c[2]) << 20) | (unsigned(c[3]) << 30);
+        }
+
+        // Same as average8, but clearing the bits that cross the 10-bit
+        // channels instead:
+        static __m128i average(__m128i a, __m128i b) {
+            __m128i carry = _mm_and_si128(_mm_srli_epi32(_mm_xor_si128(a, b), 1), _mm_set1_epi32(~0x20080200));
+            return _mm_sub_epi32(_mm_or_si128(a, b), carry);
+        }
+
+        static Value average(Value a, Value b) {
+            return (a | b) - (((a ^ b) >> 1) & ~0x20080200u);
+        }
+};
+
+/**
+ * The 64-bit formats hold linear colors, before tonemapping. They are
+ * unpacked one pixel at a time, and transposed into planes for the edge
+ * detection.
+ */
+template <class P> class Pixel16 {
+    public:
+        typedef unsigned long long Value;
+        static const int size = 8;
+        static const bool linear = true;
+
+        static Value load(const unsigned char *in) { Value v; memcpy(&v, in, 8); return v; }
+        static void store(unsigned char *out, Value v) { memcpy(out, &v, 8); }
+
+        static void rgb(const unsigned char *in, int samples, int sample, __m128 &r, __m128 &g, __m128 &b) {
+            __m128 p[4];
+            for (int i = 0; i < 4; i++)
+                p[i] = P::normalize(_mm_loadl_epi64((const __m128i *) (in + 8 * (i * samples + sample))));
+            _MM_TRANSPOSE4_PS(p[0], p[1], p[2], p[3]);
+            r = p[0], g = p[1], b = p[2];
+        }
+
+        static void averageSamples(const unsigned char *in, unsigned char *out) {
+            for (int i = 0; i < 4; i++)
+                store(out + 8 * i, P::average(load(in + 16 * i), load(in + 16 * i + 8)));
+        }
+};
+
+// Unpacked as they are:
+template <> class Pixel<Image::FORMAT_RGBA16F> : public Pixel16<Pixel<Image::FORMAT_RGBA16F> > {
+    public:
+        static __m128 normalize(__m128i p) { return unpackHalf4(p); }
+
+        static __m128 unpack(Value v) { return unpackHalf4(_mm_loadl_epi64((const __m128i *) &v)); }
+
+        static Value pack(__m128 v) {
+            Value h;
+            _mm_storel_epi64((__m128i *) &h, packHalf4(v));
+            return h;
+        }
+
+        static Value average(Value a, Value b) {
+            return pack(_mm_mul_ps(_mm_add_ps(unpack(a), unpack(b)), _mm_set1_ps(0.5f)));
+        }
+};
+
+// Unpacked to [0, 65535] for blending:
+template <> class Pixel<Image::FORMAT_RGBA16> : public Pixel16<Pixel<Image::FORMAT_RGBA16> > {
+    public:
+        static __m128 normalize(__m128i p) { return _mm_mul_ps(unpack16(p), _mm_set1_ps(1.0f / 65535.0f)); }
+
+        static __m128 unpack(Value v) { return unpack16(_mm_loadl_epi64((const __m128i *) &v)); }
+
+        static Value pack(__m128 v) {
+            // Bias to use the signed saturation of _mm_packs_epi32:
+            __m128i i = _mm_sub_epi32(_mm_cvtps_epi32(v), _mm_set1_epi32(32768));
+            i = _mm_add_epi16(_mm_packs_epi32(i, i), _mm_set1_epi16(-32768));
+            Value p;
+            _mm_storel_epi64((__m128i *) &p, i);
+            return p;
+        }
+
+        static Value average(Value a, Value b) {
+            Value p;
+            __m128i avg = _mm_avg_epu16(_mm_loadl_epi64((const __m128i *) &a), _mm_loadl_epi64((const __m128i *) &b));
+            _mm_storel_epi64((__m128i *) &p, avg);
+            return p;
+        }
+
+    private:
+        static __m128 unpack16(__m128i p) {
+            return _mm_cvtepi32_ps(_mm_unpacklo_epi16(p, _mm_setzero_si128()));
+        }
+};
+
+// Single planes, such as the Y plane of YUV frames (see SMAA::goYUV), taken
+// as gray:
+template <> class Pixel<Image::FORMAT_R8> {
+    public:
+        typedef unsigned int Value;
+        static const int size = 1;
+        static const bool linear = false;
+
+        static Value load(const unsigned char *in) { return in[0]; }
+        static void store(unsigned char *out, Value v) { out[0] = (unsigned char) v; }
+
+        static __m128 luma(const unsigned char *in, int samples, int sample) {
+            in += sample;
+            __m128i p = _mm_setr_epi32(in[0], in[samples], in[2 * samples], in[3 * samples]);
+            return _mm_mul_ps(_mm_cvtepi32_ps(p), _mm_set1_ps(1.0f / 255.0f));
+        }
+
+        static void rgb(const unsigned char *in, int samples, int sample, __m128 &r, __m128 &g, __m128 &b) {
+            r = g = b = luma(in, samples, sample);
+        }
+
+        static void averageSamples(const unsigned char *in, unsigned char *out) {
+            for (int i = 0; i < 4; i++)
+                out[i] = (unsigned char) average(in[2 * i], in[2 * i + 1]);
+        }
+
+        static __m128 unpack(Value v) { return _mm_set1_ps(float(v)); }
+        static Value pack(__m128 v) { return Value(min(max(_mm_cvtss_si32(v), 0), 255)); }
+        static Value average(Value a, Value b) { return (a + b + 1) >> 1; }
+};
+
+// Formats that are never run the edge detection on, only blended as auxiliary
+// planes (see SMAA::goPlanes), so they just load, store, and unpack to floats:
+template <> class Pixel<Image::FORMAT_R32F> {
+    public:
+        typedef unsigned int Value;
+        static const int size = 4;
+
+        static Value load(const unsigned char *in) { Value v; memcpy(&v, in, 4); return v; }
+        static void store(unsigned char *out, Value v) { memcpy(out, &v, 4); }
+
+        static __m128 unpack(Value v) { return _mm_castsi128_ps(_mm_cvtsi32_si128(int(v))); }
+        static Value pack(__m128 v) { return Value(_mm_cvtsi128_si32(_mm_castps_si128(v))); }
+        static Value average(Value a, Value b) { return pack(_mm_mul_ps(_mm_add_ps(unpack(a), unpack(b)), _mm_set1_ps(0.5f))); }
+};
+
+template <> class Pixel<Image::FORMAT_RG16F> {
+    public:
+        typedef unsigned int Value;
+        static const int size = 4;
+
+        static Value load(const unsigned char *in) { Value v; memcpy(&v, in, 4); return v; }
+        static void store(unsigned char *out, Value v) { memcpy(out, &v, 4); }
+
+        static __m128 unpack(Value v) { return unpackHalf4(_mm_cvtsi32_si128(int(v))); }
+        static Value pack(__m128 v) { return Value(_mm_cvtsi128_si32(packHalf4(v))); }
+        static Value average(Value a, Value b) { return pack(_mm_mul_ps(_mm_add_ps(unpack(a), unpack(b)), _mm_set1_ps(0.5f))); }
+};
+
+/**
+ * Converts between sRGB and linear values without calling pow(). Decoding
+ * uses a table of the 256 possible bytes. Encoding uses the exponent and the
+ * top 8 bits of the mantissa of the linear value as index, which is 3.3KB for
+ * the [2^-13, 1) range; lower values encode to 0, and the error of each entry
+ * is below 0.25 steps of the output, so that decoding and encoding a byte
+ * always returns it back.
+ */
+class SRGB {
+    public:
+        SRGB() {
+            for (int i = 0; i < 256; i++) {
+                double c = i / 255.0;
+                decodeTable[i] = float(c <= 0.04045? c / 12.92 : pow((c + 0.055) / 1.055, 2.4));
+            }
+            for (int i = 0; i < ENCODE_SIZE; i++) {
+                // Encode the center of each range:
+                unsigned int bits = ENCODE_MIN + (i << ENCODE_SHIFT) + (1 << (ENCODE_SHIFT - 1));
+                float c;
+                memcpy(&c, &bits, 4);
+                double s = c <= 0.0031308f? 12.92 * c : 1.055 * pow(double(c), 1.0 / 2.4) - 0.055;
+                encodeTable[i] = (unsigned char) (s * 255.0 + 0.5);
+            }
+        }
+
+        float decode(unsigned int c) const { return decodeTable[c]; }
+
+        unsigned int encode(float c) const {
+            const float minimum = 1.0f / 8192.0f;
+            if (!(c >= minimum)) // Also catches NaNs
+                return 0;
+            if (c >= 1.0f)
+                return 255;
+            unsigned int bits;
+            memcpy(&bits, &c, 4);
+            return encodeTable[(bits - ENCODE_MIN) >> ENCODE_SHIFT];
+        }
+
+    private:
+        static const unsigned int ENCODE_MIN = (127 - 13) << 23; // 2^-13
+        static const int ENCODE_SHIFT = 23 - 8;
+        static const int ENCODE_SIZE = 13 << 8;
+
+        float decodeTable[256];
+        unsigned char encodeTable[ENCODE_SIZE];
+};
+
+static const SRGB srgb;
+
+/**
+ * The sRGB formats are read as their plain counterparts for the edge
+ * detection, which works in gamma space, but blended and averaged in linear
+ * space (see step 5 of the integration notes in SMAA.hlsl). Alpha is linear.
+ * Only the blended pixels go through the tables, as the rest are copied;
+ * with the exception of S2x and 4x, where all the subsamples are averaged.
+ */
+template <class Base> class PixelSRGB : public Base {
+    public:
+        typedef typename Base::Value Value;
+
+        static void averageSamples(const unsigned char *in, unsigned char *out) {
+            for (int i = 0; i < 4; i++)
+                Base::store(out + Base::size * i, average(Base::load(in + Base::size * 2 * i), Base::load(in + Base::size * (2 * i + 1))));
+        }
+
+        static __m128 unpack(Value v) {
+            return _mm_setr_ps(srgb.decode(v & 0xff), srgb.decode((v >> 8) & 0xff), srgb.decode((v >> 16) & 0xff), float(v >> 24));
+        }
+
+        static Value pack(__m128 v) {
+            alignas(16) float c[4];
+            _mm_store_ps(c, v);
+            return srgb.encode(c[0]) | (srgb.encode(c[1]) << 8) | (srgb.encode(c[2]) << 16) | (pack8(v) & 0xff000000);
+        }
+
+        static Value average(Value a, Value b) {
+            if (a == b)
+                return a;
+            return pack(_mm_mul_ps(_mm_add_ps(unpack(a), unpack(b)), _mm_set1_ps(0.5f)));
+        }
+};
+
+template <> class Pixel<Image::FORMAT_RGBA8_SRGB> : public PixelSRGB<Pixel<Image::FORMAT_RGBA8> > {};
+template <> class Pixel<Image::FORMAT_BGRA8_SRGB> : public PixelSRGB<Pixel<Image::FORMAT_BGRA8> > {};
+template <> class Pixel<Image::FORMAT_RGB8_SRGB> : public PixelSRGB<Pixel<Image::FORMAT_RGB8> > {};
+template <> class Pixel<Image::FORMAT_BGR8_SRGB> : public PixelSRGB<Pixel<Image::FORMAT_BGR8> > {};
+template <> class Pixel<Image::FORMAT_RGBX8_SRGB> : public PixelSRGB<Pixel<Image::FORMAT_RGBX8> > {};
+
+/**
+ * Calls 'f' with the Pixel class of 'format', as in:
+ *     withPixel(format, [&](auto pixel) { typedef decltype(pixel) P; ... });
+ */
+template <class F>
+static inline void withPixel(Image::Format format, F f) {
+    switch (format) {
+        case Image::FORMAT_RGBA8: f(Pixel<Image::FORMAT_RGBA8>()); break;
+        case Image::FORMAT_BGRA8: f(Pixel<Image::FORMAT_BGRA8>()); break;
+        case Image::FORMAT_RGB8: f(Pixel<Image::FORMAT_RGB8>()); break;
+        case Image::FORMAT_BGR8: f(Pixel<Image::FORMAT_BGR8>()); break;
+        case Image::FORMAT_RGBX8: f(Pixel<Image::FORMAT_RGBX8>()); break;
+        case Image::FORMAT_RGB10A2: f(Pixel<Image::FORMAT_RGB10A2>()); break;
+        case Image::FORMAT_RGBA16F: f(Pixel<Image::FORMAT_RGBA16F>()); break;
+        case Image::FORMAT_RGBA16: f(Pixel<Image::FORMAT_RGBA16>()); break;
+        case Image::FORMAT_RGBA8_SRGB: f(Pixel<Image::FORMAT_RGBA8_SRGB>()); break;
+        case Image::FORMAT_BGRA8_SRGB: f(Pixel<Image::FORMAT_BGRA8_SRGB>()); break;
+        case Image::FORMAT_RGB8_SRGB: f(Pixel<Image::FORMAT_RGB8_SRGB>()); break;
+        case Image::FORMAT_BGR8_SRGB: f(Pixel<Image::FORMAT_BGR8_SRGB>()); break;
+        case Image::FORMAT_RGBX8_SRGB: f(Pixel<Image::FORMAT_RGBX8_SRGB>()); break;
+        case Image::FORMAT_R8: f(Pixel<Image::FORMAT_R8>()); break;
+        default: assert(false);
+    }
+}
+
+
+/**
+ * Same as withPixel, also taking the formats that are only blended, as
+ * auxiliary planes (see SMAA::goPlanes).
+ */
+template <class F>
+static inline void withPlanePixel(Image::Format format, F f) {
+    switch (format) {
+        case Image::FORMAT_R32F: f(Pixel<Image::FORMAT_R32F>()); break;
+        case Image::FORMAT_RG16F: f(Pixel<Image::FORMAT_RG16F>()); break;
+        default: withPixel(format, f);
+    }
+}
+
+
+SMAA::SMAA(int width, int height, Preset preset, bool predication, bool reprojection, ThreadPool *pool, const ExternalStorage &storage)
+        : width(width),
+          height(height),
+          preset(preset),
+          predication(predication),
+          reprojection(reprojection),
+          pool(pool),
+          ownsPool(pool == nullptr),
+          arena((unsigned char *) storage.data),
+          arenaSize(storage.size),
+          arenaUsed(0),
+          ownsArena(storage.data == nullptr),
+          hugePages(storage.hugePages),
+          edges(),
+          blend(),
+          scratch(nullptr),
+          borders(nullptr),
+          pending(nullptr),
+          threshold(0.1f),
+          cornerRounding(25.0f),
+          maxSearchSteps(16),
+          maxSearchStepsDiag(8),
+          frameIndex(0),
+          cachedMode(MODE_SMAA_1X),
+          cachedOutput(nullptr) {
+    if (ownsPool)
+        this->pool = new ThreadPool();
+
+    msaaOrderMap[0] = 0;
+    msaaOrderMap[1] = 1;
+
+    assert(size_t(arena) % SMAA_ARENA_ALIGNMENT == 0);
+    reserveArena(getStorageSize(width, height, this->pool->getThreadCount()));
+}
+
+
+SMAA::~SMAA() {
+    releaseArena();
+    if (ownsPool)
+        delete pool;
+}
+
+
+static inline size_t alignToArena(size_t size) {
+    return (size + SMAA_ARENA_ALIGNMENT - 1) & ~size_t(SMAA_ARENA_ALIGNMENT - 1);
+}
+
+
+static inline size_t arenaAlignment(bool hugePages) {
+    #ifdef __linux__
+    return hugePages? SMAA_HUGE_PAGE_SIZE : SMAA_ARENA_ALIGNMENT;
+    #else
+    return SMAA_ARENA_ALIGNMENT;
+    #endif
+}
+
+
+size_t SMAA::getStorageSize(int width, int height, int threads, Mode mode) {
+    // This is the sum of everything go() and goYUV() carve, in the worst case:
+    const size_t pixels = size_t(width) * height;
+    const int passes = (mode == MODE_SMAA_S2X || mode == MODE_SMAA_4X)? 2 : 1;
+    const int tasks = (height + SMAA_ROWS_PER_TASK - 1) / SMAA_ROWS_PER_TASK;
+    size_t size = passes * (alignToArena(pixels) + alignToArena(sizeof(unsigned int) * pixels)); // |edgesTex| and |blendTex|
+    size += alignToArena(sizeof(float) * scratchRowsSize(width) * threads);
+    size += alignToArena(size_t(2) * tasks * width * 8); // Blending in place the widest format
+    size += alignToArena(sizeof(unsigned long long) * 4 * width * threads);
+    size += alignToArena(max(2 * pixels, sizeof(PlaneBlend) * width * threads)); // Chroma planes of a 4:4:4 frame, blended in place, or the rows of auxiliary planes
+    return size;
+}
+
+
+/**
+ * Running out of external storage would overwrite the memory that follows
+ * it, so this is checked in release builds too.
+ */
+[[noreturn]] static void storageError(size_t needed, size_t available) {
+    fprintf(stderr, "SMAA: the external storage has %zu bytes, but %zu are needed (see getStorageSize)\n", available, needed);
+    abort();
+}
+
+
+void SMAA::reserveArena(size_t size) {
+    if (size <= arenaSize)
+        return;
+
+    // External storage must be large enough from the start:
+    if (!ownsArena)
+        storageError(size, arenaSize);
+    releaseArena();
+
+    size_t alignment = arenaAlignment(hugePages);
+    size = (size + alignment - 1) & ~(alignment - 1);
+    arena = (unsigned char *) operator new(size, align_val_t(alignment));
+    arenaSize = size;
+    #ifdef __linux__
+    if (hugePages)
+        madvise(arena, size, MADV_HUGEPAGE);
+    #endif
+
+    // Take the page faults now, from all threads at the same time, rather
+    // than in the middle of a frame:
+    const size_t chunk = size_t(1) << 20;
+    pool->parallelFor(int((size + chunk - 1) / chunk), [&](int i, int) {
+        size_t begin = i * chunk;
+        memset(arena + begin, 0, min(chunk, size - begin));
+    });
+}
+
+
+void SMAA::releaseArena() {
+    if (ownsArena && arena != nullptr)
+        operator delete(arena, align_val_t(arenaAlignment(hugePages)));
+    if (ownsArena) {
+        arena = nullptr;
+        arenaSize = 0;
+    }
+}
+
+
+unsigned char *SMAA::carve(size_t size) {
+    unsigned char *data = arena + arenaUsed;
+    if (alignToArena(size) > arenaSize - arenaUsed)
+        storageError(arenaUsed + alignToArena(size), arenaSize);
+    arenaUsed += alignToArena(size);
+    return data;
+}
+
+
+void SMAA::resize(int width, int height) {
+    if (width == this->width && height == this->height)
+        return;
+    this->width = width;
+    this->height = height;
+
+    // The arena only grows, so once sized for the largest image this never
+    // reallocates (see go):
+    edgesImage[0] = edgesImage[1] = blendImage[0] = blendImage[1] = Image();
+}
+
+
+void SMAA::go(const Image &src,
+              const Image &depth,
+              const Image &velocity,
+              const Image &dst,
+              Input input,
+              Mode mode) {
+    assert(src.width == width && src.height == height);
+    go(*getPlan(src, input), src, depth, velocity, dst, mode);
+}
+
+
+void SMAA::go(const Plan &plan,
+              const Image &src,
+              const Image &depth,
+              const Image &velocity,
+              const Image &dst,
+              Mode mode) {
+    assert(src.width == plan.width && src.height == plan.height && src.format == plan.format);
+    assert(Image::isColor(src.format) || src.format == Image::FORMAT_R8);
+    assert(dst.width == src.width && dst.height == src.height && dst.format == src.format && dst.samples == 1);
+    assert(!((plan.input == INPUT_DEPTH || predication) && !depth.isValid()));
+    assert(!(reprojection && (!velocity.isValid() || velocity.format != Image::FORMAT_RG16F)));
+    assert(!(reprojection && src.format != Image::FORMAT_RGBA8 && src.format != Image::FORMAT_BGRA8));
+    assert(!(src.data == dst.data && (src.samples > 1 || reprojection)));
+    assert(!mask.isValid() || (mask.width == src.width && mask.height == src.height));
+
+    // And here we go!
+    int passes = prepare(plan, src, dst, mode);
+    edgesDetectionPass(src, depth, plan, passes, 0, plan.tasks);
+    blendingWeightsCalculationPass(plan, mode, passes, 0, plan.tasks);
+    if (src.data == dst.data)
+        saveBorders(plan, src);
+    neighborhoodBlendingPass(plan, src, velocity, dst, passes, 0, plan.tasks);
+}
+
+
+int SMAA::prepare(const Plan &plan, const Image &src, const Image &dst, Mode mode) {
+    // S2x and 4x run two passes, one for each subsample:
+    int passes = (mode == MODE_SMAA_S2X || mode == MODE_SMAA_4X)? 2 : 1;
+    assert(src.samples == passes);
+    resize(plan.width, plan.height);
+    reserveArena(getStorageSize(width, height, pool->getThreadCount(), mode));
+
+    // The buffers are carved in the same order on every frame; this is where
+    // |edgesTex| and |blendTex| live:
+    arenaUsed = 0;
+    for (int pass = 0; pass < passes; pass++) {
+        edges[pass] = carve(size_t(width) * height);
+        blend[pass] = (unsigned int *) carve(sizeof(unsigned int) * width * height);
+        edgesImage[pass] = Image(edges[pass], width, height, width, Image::FORMAT_R8);
+        blendImage[pass] = Image(blend[pass], width, height, width * 4, Image::FORMAT_RGBA8);
+    }
+    scratch = (float *) carve(sizeof(float) * plan.scratchPerThread * pool->getThreadCount());
+
+    // Used when blending in place, see neighborhoodBlendingPass:
+    if (src.data == dst.data) {
+        borders = carve(2 * plan.tasks * size_t(width) * Image::bytesPerPixel(src.format));
+        pending = (unsigned long long *) carve(sizeof(unsigned long long) * 4 * width * pool->getThreadCount());
+    }
+    return passes;
+}
+
+
+void SMAA::goScanline(const Image &src,
+                      const Image &depth,
+                      const Image &velocity,
+                      const Image &dst,
+                      Input input,
+                      const function<void(int, int)> &rowsReady,
+                      Mode mode) {
+    assert(src.width == width && src.height == height);
+    shared_ptr<const Plan> plan = getPlan(src, input);
+    int passes = prepare(*plan, src, dst, mode);
+    if (src.data == dst.data)
+        saveBorders(*plan, src);
+
+    // The weights of a band need the edges of the bands its searches reach,
+    // and blending a band needs the weights of its rows plus the first row
+    // of the next band. Bands are blended a slice at a time (one per thread,
+    // so that the pool is kept busy), and each pass runs just as far ahead
+    // as the next slice needs.
+    //
+    // When working in place, the edges are always at least one band ahead of
+    // the blended rows, so they are detected on rows not yet written:
+    const int ahead = (plan->halo + SMAA_ROWS_PER_TASK - 1) / SMAA_ROWS_PER_TASK;
+    const int slice = pool->getThreadCount();
+    int edgesEnd = 0, weightsEnd = 0;
+    for (int first = 0; first < plan->tasks; first += slice) {
+        int last = min(first + slice, plan->tasks);
+        int weightsLast = min(last + 1, plan->tasks);
+        int edgesLast = min(weightsLast + ahead, plan->tasks);
+        if (edgesLast > edgesEnd) {
+            edgesDetectionPass(src, depth, *plan, passes, edgesEnd, edgesLast);
+            edgesEnd = edgesLast;
+        }
+        if (weightsLast > weightsEnd) {
+            blendingWeightsCalculationPass(*plan, mode, passes, weightsEnd, weightsLast);
+            weightsEnd = weightsLast;
+        }
+        neighborhoodBlendingPass(*plan, src, velocity, dst, passes, first, last);
+        rowsReady(first * SMAA_ROWS_PER_TASK, min(last * SMAA_ROWS_PER_TASK, height));
+    }
+}
+
+
+void SMAA::goIncremental(const Image &src,
+                         const Image &depth,
+                         const Image &previous,
+                         const Image &dst,
+                         const Rect *dirty, int count,
+                         Input input,
+                         Mode mode) {
+    assert(src.width == width && src.height == height);
+    assert(src.data != dst.data && !reprojection);
+    assert(previous.width == width && previous.height == height && previous.format == dst.format);
+    const int halo = getHalo();
+    const int bpp = Image::bytesPerPixel(dst.format);
+
+    // The object is resized to each region below:
+    const int frameWidth = width, frameHeight = height;
+
+    // Everything outside the dirty rectangles is the previous output:
+    if (previous.data != dst.data) {
+        const int tasks = (height + SMAA_ROWS_PER_TASK - 1) / SMAA_ROWS_PER_TASK;
+        pool->parallelFor(tasks, [&](int task, int) {
+            int y0 = task * SMAA_ROWS_PER_TASK;
+            int y1 = min(y0 + SMAA_ROWS_PER_TASK, height);
+            for (int y = y0; y < y1; y++)
+                memcpy(dst.row(y), previous.row(y), size_t(width) * bpp);
+        });
+    }
+
+    // A changed pixel changes the output up to a halo away; rectangles that
+    // overlap once grown are merged, so that no pixel is done twice:
+    auto grow = [&](const Rect &rect) {
+        int x0 = max(rect.x - halo, 0), x1 = min(rect.x + rect.width + halo, frameWidth);
+        int y0 = max(rect.y - halo, 0), y1 = min(rect.y + rect.height + halo, frameHeight);
+        return Rect(x0, y0, max(x1 - x0, 0), max(y1 - y0, 0));
+    };
+
+    // The regions and the output of each one are kept past the storage that
+    // go() needs for any of them, which is never more than for the whole
+    // frame; nothing is allocated once the arena is large enough:
+    const size_t frameStorage = getStorageSize(frameWidth, frameHeight, pool->getThreadCount(), mode);
+    const size_t outputSize = alignToArena(size_t(frameWidth) * frameHeight * bpp);
+    reserveArena(frameStorage + outputSize + alignToArena(sizeof(Rect) * count));
+    unsigned char *output = arena + frameStorage;
+    Rect *regions = (Rect *) (output + outputSize);
+
+    int regionCount = 0;
+    for (int i = 0; i < count; i++) {
+        Rect rect = grow(dirty[i]);
+        if (rect.width > 0 && rect.height > 0)
+            regions[regionCount++] = rect;
+    }
+    for (bool merged = true; merged; ) {
+        merged = false;
+        for (int i = 0; i < regionCount && !merged; i++) {
+            for (int j = i + 1; j < regionCount && !merged; j++) {
+                Rect &a = regions[i], &b = regions[j];
+                if (a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height) {
+                    int x0 = min(a.x, b.x), x1 = max(a.x + a.width, b.x + b.width);
+                    int y0 = min(a.y, b.y), y1 = max(a.y + a.height, b.y + b.height);
+                    a = Rect(x0, y0, x1 - x0, y1 - y0);
+                    regions[j] = regions[--regionCount];
+                    merged = true;
+                }
+            }
+        }
+    }
+
+    // Each region is antialiased along with a halo of its neighbors, which
+    // makes it exact, as if the whole frame was; only the region itself is
+    // copied to 'dst'. Its plan is only used here, so it is built on the
+    // stack, rather than taking a place in the cache of getPlan:
+    const Parameters parameters = getParameters();
+    Image frameMask = mask;
+    for (int i = 0; i < regionCount; i++) {
+        const Rect &region = regions[i];
+        Rect guarded = grow(region);
+        Image in = src.crop(guarded.x, guarded.y, guarded.width, guarded.height);
+        Image out(output, guarded.width, guarded.height, guarded.width * bpp, dst.format);
+        mask = frameMask.crop(guarded.x, guarded.y, guarded.width, guarded.height);
+        const Plan plan(guarded.width, guarded.height, in.format, preset, input, parameters);
+        go(plan, in, depth.crop(guarded.x, guarded.y, guarded.width, guarded.height), Image(), out, mode);
+
+        for (int y = 0; y < region.height; y++)
+            memcpy(dst.row(region.y + y) + size_t(region.x) * bpp,
+                   out.row(region.y - guarded.y + y) + size_t(region.x - guarded.x) * bpp,
+                   size_t(region.width) * bpp);
+    }
+    mask = frameMask;
+    resize(frameWidth, frameHeight);
+}
+
+
+/**
+ * Hashes 'size' bytes, continuing from 'hash', eight at a time with the
+ * rounds of xxHash64. It only has to tell whether a tile changed since the
+ * last frame, so there is no final mixing.
+ */
+static inline unsigned long long hashBytes(const unsigned char *data, size_t size, unsigned long long hash) {
+    const unsigned long long prime1 = 0x9e3779b185ebca87ull, prime2 = 0xc2b2ae3d27d4eb4full;
+    auto rotl = [](unsigned long long x, int r) { return (x << r) | (x >> (64 - r)); };
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        unsigned long long v;
+        memcpy(&v, data + i, 8);
+        hash ^= rotl(v * prime2, 31) * prime1;
+        hash = rotl(hash, 27) * prime1 + 0x85ebca77c2b2ae63ull;
+    }
+    for (; i < size; i++)
+        hash = rotl(hash ^ (data[i] * 0x27d4eb2f165667c5ull), 11) * prime1;
+    return hash;
+}
+
+
+void SMAA::goCached(const Image &src,
+                    const Image &depth,
+                    const Image &dst,
+                    Input input,
+                    Mode mode) {
+    assert(src.width == width && src.height == height);
+    assert(src.data != dst.data && !reprojection);
+    const int tilesX = (width + SMAA_TILE_SIZE - 1) / SMAA_TILE_SIZE;
+    const int tilesY = (height + SMAA_TILE_SIZE - 1) / SMAA_TILE_SIZE;
+
+    // Anything but the contents of the images changing since the last call
+    // means starting over. The plan is compared by what it was built from,
+    // as the cache of getPlan may have dropped and rebuilt it meanwhile; the
+    // one kept here is reused for as long as it matches:
+    const bool samePlan = cachedPlan &&
+                          cachedPlan->matches(src.width, src.height, src.format, preset, input, getParameters());
+    const bool valid = samePlan && mode == cachedMode && dst.data == cachedOutput &&
+                       tileHashes.size() == size_t(tilesX) * tilesY;
+    if (!samePlan)
+        cachedPlan = getPlan(src, input);
+    const Plan &plan = *cachedPlan;
+    cachedMode = mode;
+    cachedOutput = dst.data;
+    tileHashes.resize(size_t(tilesX) * tilesY);
+    tileChanged.resize(size_t(tilesX) * tilesY);
+
+    // Everything the output of a tile depends on, besides its neighbors:
+    const bool hashDepth = depth.isValid() && (input == INPUT_DEPTH || predication);
+    const int srcBpp = Image::bytesPerPixel(src.format) * src.samples;
+    const int depthBpp = hashDepth? Image::bytesPerPixel(depth.format) * depth.samples : 0;
+    pool->parallelFor(tilesY, [&](int ty, int) {
+        int y0 = ty * SMAA_TILE_SIZE, y1 = min(y0 + SMAA_TILE_SIZE, height);
+        for (int tx = 0; tx < tilesX; tx++) {
+            int x0 = tx * SMAA_TILE_SIZE, x1 = min(x0 + SMAA_TILE_SIZE, width);
+            unsigned long long hash = 0;
+            for (int y = y0; y < y1; y++) {
+                hash = hashBytes(src.row(y) + size_t(x0) * srcBpp, size_t(x1 - x0) * srcBpp, hash);
+                if (hashDepth)
+                    hash = hashBytes(depth.row(y) + size_t(x0) * depthBpp, size_t(x1 - x0) * depthBpp, hash);
+                if (mask.isValid())
+                    hash = hashBytes(mask.row(y) + x0, x1 - x0, hash);
+            }
+            size_t i = size_t(ty) * tilesX + tx;
+            tileChanged[i] = hash != tileHashes[i];
+            tileHashes[i] = hash;
+        }
+    });
+    if (!valid) {
+        go(plan, src, depth, Image(), dst, mode);
+        return;
+    }
+
+    // The changed tiles are joined into runs along each row of tiles, and
+    // redone with goIncremental, which takes care of their halo:
+    dirtyTiles.clear();
+    size_t area = 0;
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            if (!tileChanged[size_t(ty) * tilesX + tx])
+                continue;
+            int run = tx;
+            while (tx + 1 < tilesX && tileChanged[size_t(ty) * tilesX + tx + 1])
+                tx++;
+            int x0 = run * SMAA_TILE_SIZE, x1 = min((tx + 1) * SMAA_TILE_SIZE, width);
+            int y0 = ty * SMAA_TILE_SIZE, y1 = min(y0 + SMAA_TILE_SIZE, height);
+            dirtyTiles.push_back(Rect(x0, y0, x1 - x0, y1 - y0));
+            area += size_t(x1 - x0) * (y1 - y0);
+        }
+    }
+
+    // Past half of the frame, the halos make it cheaper to just redo it all:
+    if (dirtyTiles.empty())
+        return;
+    if (2 * area > size_t(width) * height)
+        go(plan, src, depth, Image(), dst, mode);
+    else
+        goIncremental(src, depth, dst, dst, dirtyTiles.data(), int(dirtyTiles.size()), input, mode);
+}
+
+
+shared_ptr<SMAA::Job> SMAA::start(const Image &src,
+                                  const Image &depth,
+                                  const Image &velocity,
+                                  const Image &dst,
+                                  Input input,
+                                  Mode mode) {
+    assert(src.width == width && src.height == height);
+    shared_ptr<const Plan> plan = getPlan(src, input);
+    int passes = prepare(*plan, src, dst, mode);
+    return shared_ptr<Job>(new Job(this, plan, src, depth, velocity, dst, mode, passes));
+}
+
+
+SMAA::Job::Job(SMAA *smaa, shared_ptr<const Plan> plan,
+               const Image &src, const Image &depth, const Image &velocity, const Image &dst,
+               Mode mode, int passes)
+        : smaa(smaa),
+          plan(plan),
+          src(src),
+          depth(depth),
+          velocity(velocity),
+          dst(dst),
+          mode(mode),
+          passes(passes),
+          phase(PHASE_EDGES),
+          next(0),
+          sliceTime(0.0),
+          cancelled(false) {}
+
+
+bool SMAA::Job::step(double budget) {
+    typedef chrono::steady_clock Clock;
+    const Clock::time_point start = Clock::now();
+    const int bands = smaa->pool->getThreadCount();
+
+    for (double elapsed = 0.0; phase != PHASE_DONE && !cancelled; ) {
+        // Don't start a slice that is expected to go over the budget, unless
+        // it is the first one:
+        if (elapsed > 0.0 && elapsed + sliceTime > budget)
+            break;
+
+        int first = next, last = min(next + bands, plan->tasks);
+        switch (phase) {
+            case PHASE_EDGES:
+                smaa->edgesDetectionPass(src, depth, *plan, passes, first, last);
+                break;
+            case PHASE_WEIGHTS:
+                smaa->blendingWeightsCalculationPass(*plan, mode, passes, first, last);
+                break;
+            case PHASE_BLENDING:
+                if (first == 0 && src.data == dst.data)
+                    smaa->saveBorders(*plan, src);
+                smaa->neighborhoodBlendingPass(*plan, src, velocity, dst, passes, first, last);
+                break;
+            default:
+                break;
+        }
+        next = last;
+        if (next == plan->tasks) {
+            phase = Phase(phase + 1);
+            next = 0;
+        }
+
+        // Slices of the three passes take about the same, so a running
+        // average of all of them is a good enough estimate for the next one:
+        double now = chrono::duration<double, milli>(Clock::now() - start).count();
+        sliceTime = sliceTime == 0.0? now - elapsed : 0.75 * sliceTime + 0.25 * (now - elapsed);
+        elapsed = now;
+    }
+    return phase == PHASE_DONE || cancelled;
+}
+
+
+future<bool> SMAA::Job::run() {
+    shared_ptr<Job> self = shared_from_this();
+    shared_ptr<promise<bool>> result = make_shared<promise<bool>>();
+    future<bool> done = result->get_future();
+    smaa->pool->submit([self, result] {
+        while (!self->step(numeric_limits<double>::infinity())) {}
+        result->set_value(!self->cancelled);
+    });
+    return done;
+}
+
+
+shared_ptr<const SMAA::Plan> SMAA::getPlan(const Image &src, Input input) {
+    Parameters parameters = getParameters();
+    if (lastPlan && lastPlan->matches(src.width, src.height, src.format, preset, input, parameters))
+        return lastPlan;
+
+    // The cache is shared by all objects, most recently used plans first:
+    static mutex cacheMutex;
+    static vector<shared_ptr<const Plan>> cache;
+
+    lock_guard<mutex> lock(cacheMutex);
+    auto i = find_if(cache.begin(), cache.end(), [&](const shared_ptr<const Plan> &plan) {
+        return plan->matches(src.width, src.height, src.format, preset, input, parameters);
+    });
+    if (i != cache.end()) {
+        lastPlan = *i;
+        cache.erase(i);
+    } else
+        lastPlan = make_shared<const Plan>(src.width, src.height, src.format, preset, input, parameters);
+    cache.insert(cache.begin(), lastPlan);
+    if (cache.size() > SMAA_PLAN_CACHE_SIZE)
+        cache.pop_back();
+    return lastPlan;
+}
+
+
+SMAA::Parameters SMAA::getParameters() const {
+    // These match the presets of SMAA.hlsl:
+    static const Parameters presets[] = {
+        { 0.15f,  4,  0,  0.0f, false, false }, // SMAA_PRESET_LOW
+        { 0.1f,   8,  0,  0.0f, false, false }, // SMAA_PRESET_MEDIUM
+        { 0.1f,  16,  8, 25.0f, true,  true  }, // SMAA_PRESET_HIGH
+        { 0.05f, 32, 16, 25.0f, true,  true  }, // SMAA_PRESET_ULTRA
+    };
+
+    if (preset == PRESET_CUSTOM) {
+        Parameters parameters = { threshold, maxSearchSteps, maxSearchStepsDiag, cornerRounding, true, true };
+        return parameters;
+    } else
+        return presets[int(preset)];
+}
+
+
+/**
+ * The searches end up to two steps further than their length, and then read
+ * the crossing edges; edges depend on pixels two away, and the blending on the
+ * weights of the next pixel.
+ */
+static int haloOf(int maxSearchSteps, int maxSearchStepsDiag) {
+    return max(2 * maxSearchSteps, maxSearchStepsDiag) + 8;
+}
+
+
+int SMAA::getHalo() const {
+    Parameters parameters = getParameters();
+    return haloOf(parameters.maxSearchSteps, parameters.maxSearchStepsDiag);
+}
+
+
+void SMAA::getJitter(Mode mode, float jitter[2]) const {
+    switch (mode) {
+        case MODE_SMAA_1X:
+        case MODE_SMAA_S2X:
+            jitter[0] = jitter[1] = 0.0f;
+            break;
+        case MODE_SMAA_T2X: {
+            static const float jitters[][2] = {
+                { -0.25f,  0.25f },
+                {  0.25f, -0.25f }
+            };
+            jitter[0] = jitters[frameIndex % 2][0];
+            jitter[1] = jitters[frameIndex % 2][1];
+            break;
+        }
+        case MODE_SMAA_4X: {
+            static const float jitters[][2] = {
+                { -0.125f, -0.125f },
+                {  0.125f,  0.125f }
+            };
+            jitter[0] = jitters[frameIndex % 2][0];
+            jitter[1] = jitters[frameIndex % 2][1];
+            break;
+        }
+        case MODE_SMAA_CUSTOM:
+            assert(pattern.count > 0);
+            jitter[0] = pattern.jitters[frameIndex % pattern.count][0];
+            jitter[1] = pattern.jitters[frameIndex % pattern.count][1];
+            break;
+    }
+}
+
+
+void SMAA::nextFrame() {
+    // Patterns of any length are allowed, so the counter wraps at a multiple
+    // of both their length and two:
+    int period = pattern.count > 0? 2 * pattern.count : 2;
+    frameIndex = (frameIndex + 1) % period;
+}
+
+
+void SMAA::setMask(const Image &mask) {
+    assert(!mask.isValid() || mask.format == Image::FORMAT_R8);
+    this->mask = mask;
+}
+
+
+void SMAA::setMask(const Rect *rects, int count) {
+    maskStorage.assign(size_t(width) * height, 0);
+    for (int i = 0; i < count; i++) {
+        int x0 = max(rects[i].x, 0), x1 = min(rects[i].x + rects[i].width, width);
+        int y0 = max(rects[i].y, 0), y1 = min(rects[i].y + rects[i].height, height);
+        for (int y = y0; y < y1 && x0 < x1; y++)
+            memset(maskStorage.data() + size_t(y) * width + x0, 1, x1 - x0);
+    }
+    mask = Image(maskStorage.data(), width, height, width, Image::FORMAT_R8);
+}
+
+
+void SMAA::setSubsamplePattern(const SubsamplePattern &pattern) {
+    assert(pattern.count == 0 || (pattern.jitters != nullptr && pattern.subsampleIndices != nullptr && pattern.areaTexBytes != nullptr));
+    this->pattern = pattern;
+    frameIndex = 0;
+}
+
+
+int SMAA::getSubsampleIndex(Mode mode, int pass) const {
+    switch (mode) {
+        case MODE_SMAA_T2X:
+            return frameIndex % 2;
+        case MODE_SMAA_S2X:
+            return msaaReorder(pass);
+        case MODE_SMAA_4X:
+            return 2 * (frameIndex % 2) + msaaReorder(pass);
+        case MODE_SMAA_CUSTOM:
+            return frameIndex % pattern.count;
+        default:
+            return 0;
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+// Edge detection (first pass)
+
+/**
+ * Calls f(x, in) for each group of four pixels of a row, with 'in' pointing
+ * to the first one. The last group is copied into a local buffer first, so
+ * that it can be read four pixels at a time as well.
+ */
+template <class P, class F>
+static inline void forEachQuad(const Image &src, int y, F f) {
+    const unsigned char *in = src.row(y);
+    const int stride = P::size * src.samples;
+    int x = 0;
+    for (; x + 4 <= src.width; x += 4)
+        f(x, in + stride * x);
+    if (x < src.width) {
+        alignas(16) unsigned char tail[4 * 2 * 8] = {};
+        memcpy(tail, in + stride * x, stride * (src.width - x));
+        f(x, tail);
+    }
+}
+
+
+/**
+ * Maps linear HDR values to a perceptual scale, so that the thresholds mean
+ * the same as for gamma space colors. This is sqrt(2x / (1 + x)), which is
+ * close to gamma 2.0 below 1.0, and compresses highlights towards sqrt(2).
+ */
+static inline __m128 perceptual(__m128 v) {
+    v = _mm_max_ps(v, _mm_setzero_ps());
+    return _mm_sqrt_ps(_mm_div_ps(_mm_add_ps(v, v), _mm_add_ps(v, _mm_set1_ps(1.0f))));
+}
+
+
+/**
+ * Converts a row of the input into the planar float rows the edge detection
+ * works on, replicating the borders into the padding (clamp addressing). The
+ * last group of four pixels may write up to three values into the padding,
+ * before it is filled.
+ */
+template <class P>
+static void loadLumaRow(const Image &src, int y, int sample, float *const out[3]) {
+    forEachQuad<P>(src, y, [&](int x, const unsigned char *in) {
+        __m128 r, g, b;
+        P::rgb(in, src.samples, sample, r, g, b);
+        __m128 l = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.2126f)),
+                                         _mm_mul_ps(g, _mm_set1_ps(0.7152f))),
+                                         _mm_mul_ps(b, _mm_set1_ps(0.0722f)));
+        _mm_storeu_ps(out[0] + x, P::linear? perceptual(l) : l);
+    });
+}
+
+
+static void loadPlaneRow(const Image &src, int y, int sample, float *const out[3]) {
+    typedef Pixel<Image::FORMAT_R8> P;
+    forEachQuad<P>(src, y, [&](int x, const unsigned char *in) {
+        _mm_storeu_ps(out[0] + x, P::luma(in, src.samples, sample));
+    });
+}
+
+
+template <class P>
+static void loadColorRow(const Image &src, int y, int sample, float *const out[3]) {
+    forEachQuad<P>(src, y, [&](int x, const unsigned char *in) {
+        __m128 r, g, b;
+        P::rgb(in, src.samples, sample, r, g, b);
+        if (P::linear) {
+            r = perceptual(r);
+            g = perceptual(g);
+            b = perceptual(b);
+        }
+        _mm_storeu_ps(out[0] + x, r);
+        _mm_storeu_ps(out[1] + x, g);
+        _mm_storeu_ps(out[2] + x, b);
+    });
+}
+
+
+static void loadFloatRow(const Image &src, int y, float *out) {
+    memcpy(out, src.row(y), src.width * sizeof(float));
+}
+
+
+static void loadDepthRow(const Image &depth, int y, int, float *const out[3]) {
+    loadFloatRow(depth, y, out[0]);
+}
+
+
+static void padRow(float *row, int width) {
+    for (int i = 1; i <= SMAA_ROW_PADDING; i++) {
+        row[-i] = row[0];
+        row[width - 1 + i] = row[width - 1];
+    }
+}
+
+
+SMAA::Plan::Plan(int width, int height, Image::Format format, Preset preset, Input input, const Parameters &parameters)
+        : width(width),
+          height(height),
+          format(format),
+          preset(preset),
+          input(input),
+          parameters(parameters),
+          tasks((height + SMAA_ROWS_PER_TASK - 1) / SMAA_ROWS_PER_TASK),
+          halo(haloOf(parameters.maxSearchSteps, parameters.maxSearchStepsDiag)),
+          loadRow(loadDepthRow) {
+    stride = width + 2 * SMAA_ROW_PADDING;
+    planes = input == INPUT_COLOR? 3 : 1;
+    scratchPerThread = scratchRowsSize(width);
+
+    switch (input) {
+        case INPUT_LUMA:
+            // Single planes already are luma:
+            if (format == Image::FORMAT_R8)
+                loadRow = loadPlaneRow;
+            else
+                withPixel(format, [&](auto pixel) { loadRow = loadLumaRow<decltype(pixel)>; });
+            break;
+        case INPUT_COLOR:
+            withPixel(format, [&](auto pixel) { loadRow = loadColorRow<decltype(pixel)>; });
+            break;
+        case INPUT_DEPTH:
+            break;
+    }
+}
+
+
+bool SMAA::Plan::matches(int width, int height, Image::Format format, Preset preset, Input input, const Parameters &parameters) const {
+    // Custom parameters can change at any time:
+    bool sameParameters = preset != PRESET_CUSTOM ||
+                          (parameters.threshold == this->parameters.threshold &&
+                           parameters.maxSearchSteps == this->parameters.maxSearchSteps &&
+                           parameters.maxSearchStepsDiag == this->parameters.maxSearchStepsDiag &&
+                           parameters.cornerRounding == this->parameters.cornerRounding);
+    return width == this->width && height == this->height && format == this->format &&
+           preset == this->preset && input == this->input && sameParameters;
+}
+
+
+void SMAA::edgesDetectionPass(const Image &src, const Image &depth, const Plan &plan, int passes, int first, int last) {
+    const int stride = plan.stride;
+    const int planes = plan.planes;
+    const Input input = plan.input;
+    const Parameters &parameters = plan.parameters;
+
+    // The bands of all passes are interleaved, so that they run at the same
+    // time:
+    pool->parallelFor((last - first) * passes, [&](int index, int thread) {
+        int task = first + index / passes, pass = index % passes;
+        float *base = scratch + size_t(thread) * plan.scratchPerThread + SMAA_ROW_PADDING;
+
+        // Rows y - 2, y - 1, y and y + 1 are needed for each row y; they are
+        // kept in a ring indexed by (y & 3):
+        auto ring = [&](int y, int plane) { return base + ((y & 3) * 3 + plane) * stride; };
+        auto predicationRow = [&](int y) { return base + (12 + (y & 1)) * stride; };
+
+        auto load = [&](int y) {
+            int sy = min(max(y, 0), height - 1);
+            float *rows[3] = { ring(y, 0), ring(y, 1), ring(y, 2) };
+            plan.loadRow(input == INPUT_DEPTH? depth : src, sy, pass, rows);
+            for (int plane = 0; plane < planes; plane++)
+                padRow(ring(y, plane), width);
+
+            if (predication && input != INPUT_DEPTH) {
+                loadFloatRow(depth, sy, predicationRow(y));
+                padRow(predicationRow(y), width);
+            }
+        };
+
+        int y0 = task * SMAA_ROWS_PER_TASK;
+        int y1 = min(y0 + SMAA_ROWS_PER_TASK, height);
+        for (int y = y0 - 2; y <= y0; y++)
+            load(y);
+
+        for (int y = y0; y < y1; y++) {
+            load(y + 1);
+
+            unsigned char *out = edges[pass] + size_t(y) * width;
+
+            // Calculate the threshold:
+            __m128 threshold = _mm_set1_ps(parameters.threshold);
+            __m128 thresholdX = threshold, thresholdY = threshold;
+
+            const unsigned char *maskRow = mask.isValid()? mask.row(y) : nullptr;
+            const unsigned char *maskTop = mask.isValid() && y > 0? mask.row(y - 1) : nullptr;
+
+            for (int x = 0; x < width; x += 4) {
+                int count = min(4, width - x);
+
+                // Masked pixels have no edges at all, so they cost nothing in
+                // the next passes either:
+                if (maskRow != nullptr) {
+                    int masked = 0;
+                    for (int i = 0; i < count; i++)
+                        masked += maskRow[x + i] != 0;
+                    if (masked == count) {
+                        memset(out + x, 0, count);
+                        continue;
+                    }
+                }
+
+                if (predication && input != INPUT_DEPTH) {
+                    const float *P0 = predicationRow(y) + x, *P1 = predicationRow(y - 1) + x;
+                    __m128 P = _mm_loadu_ps(P0);
+                    __m128 deltaX = abs_ps(_mm_sub_ps(P, _mm_loadu_ps(P0 - 1)));
+                    __m128 deltaY = abs_ps(_mm_sub_ps(P, _mm_loadu_ps(P1)));
+                    __m128 scale = _mm_set1_ps(SMAA_PREDICATION_SCALE * parameters.threshold);
+                    __m128 strength = _mm_set1_ps(SMAA_PREDICATION_SCALE * parameters.threshold * SMAA_PREDICATION_STRENGTH);
+                    __m128 predicationThreshold = _mm_set1_ps(SMAA_PREDICATION_THRESHOLD);
+                    thresholdX = _mm_sub_ps(scale, _mm_and_ps(_mm_cmpge_ps(deltaX, predicationThreshold), strength));
+                    thresholdY = _mm_sub_ps(scale, _mm_and_ps(_mm_cmpge_ps(deltaY, predicationThreshold), strength));
+                }
+
+                switch (input) {
+                    case INPUT_LUMA: {
+                        const float *L0 = ring(y, 0) + x;
+                        __m128 L = _mm_loadu_ps(L0);
+                        __m128 Lleft = _mm_loadu_ps(L0 - 1);
+                        __m128 Ltop = _mm_loadu_ps(ring(y - 1, 0) + x);
+
+                        // We do the usual threshold:
+                        __m128 deltaX = abs_ps(_mm_sub_ps(L, Lleft));
+                        __m128 deltaY = abs_ps(_mm_sub_ps(L, Ltop));
+                        __m128 edgesX = _mm_cmpge_ps(deltaX, thresholdX);
+                        __m128 edgesY = _mm_cmpge_ps(deltaY, thresholdY);
+
+                        // Then discard if there is no edge:
+                        if (_mm_movemask_ps(_mm_or_ps(edgesX, edgesY)) == 0) {
+                            memset(out + x, 0, count);
+                            continue;
+                        }
+
+                        // Calculate right and bottom deltas, and the maximum
+                        // delta in the direct neighborhood:
+                        __m128 maxDeltaX = _mm_max_ps(deltaX, abs_ps(_mm_sub_ps(L, _mm_loadu_ps(L0 + 1))));
+                        __m128 maxDeltaY = _mm_max_ps(deltaY, abs_ps(_mm_sub_ps(L, _mm_loadu_ps(ring(y + 1, 0) + x))));
+
+                        // Calculate left-left and top-top deltas:
+                        maxDeltaX = _mm_max_ps(maxDeltaX, abs_ps(_mm_sub_ps(Lleft, _mm_loadu_ps(L0 - 2))));
+                        maxDeltaY = _mm_max_ps(maxDeltaY, abs_ps(_mm_sub_ps(Ltop, _mm_loadu_ps(ring(y - 2, 0) + x))));
+                        __m128 finalDelta = _mm_max_ps(maxDeltaX, maxDeltaY);
+
+                        // Local contrast adaptation:
+                        __m128 factor = _mm_set1_ps(SMAA_LOCAL_CONTRAST_ADAPTATION_FACTOR);
+                        edgesX = _mm_and_ps(edgesX, _mm_cmpge_ps(_mm_mul_ps(factor, deltaX), finalDelta));
+                        edgesY = _mm_and_ps(edgesY, _mm_cmpge_ps(_mm_mul_ps(factor, deltaY), finalDelta));
+
+                        storeEdges(out + x, edgesX, edgesY, count);
+                        break;
+                    }
+                    case INPUT_COLOR: {
+                        // Calculates max(|C - N|) over the three channels, for
+                        // the neighbor at (dx, dy):
+                        auto delta = [&](int dx, int dy) {
+                            __m128 t = _mm_setzero_ps();
+                            for (int c = 0; c < 3; c++) {
+                                __m128 C = _mm_loadu_ps(ring(y, c) + x);
+                                __m128 N = _mm_loadu_ps(ring(y + dy, c) + x + dx);
+                                t = _mm_max_ps(t, abs_ps(_mm_sub_ps(C, N)));
+                            }
+                            return t;
+                        };
+
+                        // We do the usual threshold:
+                        __m128 deltaX = delta(-1, 0);
+                        __m128 deltaY = delta(0, -1);
+                        __m128 edgesX = _mm_cmpge_ps(deltaX, thresholdX);
+                        __m128 edgesY = _mm_cmpge_ps(deltaY, thresholdY);
+
+                        // Then discard if there is no edge:
+                        if (_mm_movemask_ps(_mm_or_ps(edgesX, edgesY)) == 0) {
+                            memset(out + x, 0, count);
+                            continue;
+                        }
+
+                        // Calculate right and bottom deltas, and the maximum
+                        // delta in the direct neighborhood:
+                        __m128 maxDeltaX = _mm_max_ps(deltaX, delta(1, 0));
+                        __m128 maxDeltaY = _mm_max_ps(deltaY, delta(0, 1));
+
+                        // Calculate left-left and top-top deltas:
+                        maxDeltaX = _mm_max_ps(maxDeltaX, delta(-2, 0));
+                        maxDeltaY = _mm_max_ps(maxDeltaY, delta(0, -2));
+                        __m128 finalDelta = _mm_max_ps(maxDeltaX, maxDeltaY);
+
+                        // Local contrast adaptation:
+                        __m128 factor = _mm_set1_ps(SMAA_LOCAL_CONTRAST_ADAPTATION_FACTOR);
+                        edgesX = _mm_and_ps(edgesX, _mm_cmpge_ps(_mm_mul_ps(factor, deltaX), finalDelta));
+                        edgesY = _mm_and_ps(edgesY, _mm_cmpge_ps(_mm_mul_ps(factor, deltaY), finalDelta));
+
+                        storeEdges(out + x, edgesX, edgesY, count);
+                        break;
+                    }
+                    case INPUT_DEPTH: {
+                        const float *D0 = ring(y, 0) + x;
+                        __m128 D = _mm_loadu_ps(D0);
+                        __m128 deltaX = abs_ps(_mm_sub_ps(D, _mm_loadu_ps(D0 - 1)));
+                        __m128 deltaY = abs_ps(_mm_sub_ps(D, _mm_loadu_ps(ring(y - 1, 0) + x)));
+                        __m128 depthThreshold = _mm_set1_ps(0.1f * parameters.threshold); // SMAA_DEPTH_THRESHOLD
+                        storeEdges(out + x, _mm_cmpge_ps(deltaX, depthThreshold), _mm_cmpge_ps(deltaY, depthThreshold), count);
+                        break;
+                    }
+                }
+
+                if (maskRow != nullptr)
+                    maskEdges(out + x, maskRow + x, maskTop != nullptr? maskTop + x : nullptr, x == 0, count);
+            }
+        }
+    });
+}
+
+
+void SMAA::blendingWeightsCalculationPass(const Plan &plan, Mode mode, int passes, int first, int last) {
+    const Parameters &parameters = plan.parameters;
+
+    /**
+     * Orthogonal indices:
+     *     [0]:  0.0
+     *     [1]: -0.25
+     *     [2]:  0.25
+     *     [3]: -0.125
+     *     [4]:  0.125
+     *     [5]: -0.375
+     *     [6]:  0.375
+     *
+     * Diagonal indices:
+     *     [0]:  0.00,   0.00
+     *     [1]:  0.25,  -0.25
+     *     [2]: -0.25,   0.25
+     *     [3]:  0.125, -0.125
+     *     [4]: -0.125,  0.125
+     *
+     * Indices layout: indices[4] = { |, --,  /, \ }
+     */
+    float subsampleIndices[2][4] = {};
+    for (int pass = 0; pass < passes; pass++) {
+        int subsampleIndex = getSubsampleIndex(mode, pass);
+        switch (mode) {
+            case MODE_SMAA_1X:
+                // Just pass zero for SMAA 1x, see @SUBSAMPLE_INDICES.
+                break;
+            case MODE_SMAA_T2X:
+            case MODE_SMAA_S2X: {
+                /***
+                 * Sample positions (bottom-to-top y axis):
+                 *   _______
+                 *  | S1    |  S0:  0.25    -0.25
+                 *  |       |  S1: -0.25     0.25
+                 *  |____S0_|
+                 */
+                static const float indices[][4] = {
+                    { 1.0f, 1.0f, 1.0f, 0.0f }, // S0
+                    { 2.0f, 2.0f, 2.0f, 0.0f }  // S1
+                    // (it's 1 for the horizontal slot of S0 because horizontal
+                    //  blending is reversed: positive numbers point to the right)
+                };
+                copy(indices[subsampleIndex], indices[subsampleIndex] + 4, subsampleIndices[pass]);
+                break;
+            }
+            case MODE_SMAA_4X: {
+                /***
+                 * Sample positions (bottom-to-top y axis):
+                 *   ________
+                 *  |  S1    |  S0:  0.3750   -0.1250
+                 *  |      S0|  S1: -0.1250    0.3750
+                 *  |S3      |  S2:  0.1250   -0.3750
+                 *  |____S2__|  S3: -0.3750    0.1250
+                 */
+                static const float indices[][4] = {
+                    { 5.0f, 3.0f, 1.0f, 3.0f }, // S0
+                    { 4.0f, 6.0f, 2.0f, 3.0f }, // S1
+                    { 3.0f, 5.0f, 1.0f, 4.0f }, // S2
+                    { 6.0f, 4.0f, 2.0f, 4.0f }  // S3
+                };
+                copy(indices[subsampleIndex], indices[subsampleIndex] + 4, subsampleIndices[pass]);
+                break;
+            }
+            case MODE_SMAA_CUSTOM:
+                // Generated by Scripts/AreaTex.py, see @SUBSAMPLE_PATTERN.
+                assert(pattern.count > 0);
+                copy(pattern.subsampleIndices[subsampleIndex], pattern.subsampleIndices[subsampleIndex] + 4, subsampleIndices[pass]);
+                break;
+        }
+    }
+
+    // Custom patterns bring their own area texture, with extra offset slots:
+    const LookupTexture areaTex = mode == MODE_SMAA_CUSTOM?
+        LookupTexture(pattern.areaTexBytes, AREATEX_WIDTH, pattern.areaTexHeight, 2) :
+        standardAreaTex;
+
+    EdgesTexture edgesTex[2] = {
+        EdgesTexture(edges[0], width, height),
+        EdgesTexture(edges[1], width, height)
+    };
+    auto calculation = [&](int pass) {
+        return BlendingWeightCalculation(edgesTex[pass], areaTex, subsampleIndices[pass],
+                                         parameters.maxSearchSteps, parameters.maxSearchStepsDiag, parameters.cornerRounding,
+                                         parameters.diagDetection, parameters.cornerDetection);
+    };
+    const BlendingWeightCalculation calculations[2] = { calculation(0), calculation(1) };
+
+    pool->parallelFor((last - first) * passes, [&](int index, int) {
+        int task = first + index / passes, pass = index % passes;
+        const BlendingWeightCalculation &calculation = calculations[pass];
+        int y0 = task * SMAA_ROWS_PER_TASK;
+        int y1 = min(y0 + SMAA_ROWS_PER_TASK, height);
+        for (int y = y0; y < y1; y++) {
+            const unsigned char *e = edges[pass] + size_t(y) * width;
+            unsigned int *out = blend[pass] + size_t(y) * width;
+            for (int x = 0; x < width; x++) {
+                if (e[x] == 0) {
+                    out[x] = 0;
+                    continue;
+                }
+
+                // Weights are quantized to R8G8B8A8_UNORM right away, so that
+                // the intermediate storage is 4 bytes per pixel, and the
+                // results match the GPU ones:
+                alignas(16) float weights[4];
+                calculation.go(x, y, e[x], weights);
+                out[x] = packUnorm8(_mm_load_ps(weights));
+            }
+        }
+    });
+}
+
+
+/**
+ * Averages the two subsamples of a 2x multisampled row.
+ */
+template <class P>
+static void averageSamplesRow(const unsigned char *src, unsigned char *out, int width) {
+    int x = 0;
+    for (; x + 4 <= width; x += 4)
+        P::averageSamples(src + P::size * 2 * x, out + P::size * x);
+    for (; x < width; x++)
+        P::store(out + P::size * x, P::average(P::load(src + P::size * 2 * x), P::load(src + P::size * (2 * x + 1))));
+}
+
+
+/**
+ * When working in place, only the blended pixels are written. Each row is
+ * written once the next one has been blended, so that its neighbors still
+ * read it unmodified; but the first and last rows of each band are read by
+ * the neighbor bands at any time, so we keep a copy of them, taken before
+ * any band is blended.
+ */
+void SMAA::saveBorders(const Plan &plan, const Image &src) {
+    const size_t rowSize = size_t(width) * Image::bytesPerPixel(src.format);
+    pool->parallelFor(plan.tasks, [&](int task, int) {
+        int y0 = task * SMAA_ROWS_PER_TASK;
+        int y1 = min(y0 + SMAA_ROWS_PER_TASK, height);
+        memcpy(borders + 2 * task * rowSize, src.row(y0), rowSize);
+        memcpy(borders + (2 * task + 1) * rowSize, src.row(y1 - 1), rowSize);
+    });
+}
+
+
+void SMAA::neighborhoodBlendingPass(const Plan &, const Image &src, const Image &velocity, const Image &dst, int passes, int first, int last) {
+    const size_t rowSize = size_t(width) * Image::bytesPerPixel(src.format);
+
+    // See saveBorders:
+    const bool inPlace = src.data == dst.data;
+
+    pool->parallelFor(last - first, [&](int index, int thread) {
+        const int task = first + index;
+        withPixel(src.format, [&](auto pixel) {
+            typedef decltype(pixel) P;
+            int y0 = task * SMAA_ROWS_PER_TASK;
+            int y1 = min(y0 + SMAA_ROWS_PER_TASK, height);
+
+            auto srcRow = [&](int y) -> const unsigned char * {
+                y = min(max(y, 0), height - 1);
+                if (inPlace && y < y0)
+                    return borders + (2 * task - 1) * rowSize;
+                if (inPlace && y >= y1)
+                    return borders + 2 * (task + 1) * rowSize;
+                return src.row(y);
+            };
+
+            // Writes pending for the last two rows when working in place, as
+            // (x, color) pairs:
+            unsigned long long *writes[2];
+            writes[0] = pending + size_t(4) * width * thread;
+            writes[1] = writes[0] + 2 * width;
+            int count[2] = { 0, 0 };
+            auto flush = [&](int y) {
+                unsigned char *out = dst.row(y);
+                const unsigned long long *w = writes[y & 1];
+                for (int i = 0; i < count[y & 1]; i++)
+                    P::store(out + P::size * w[2 * i], typename P::Value(w[2 * i + 1]));
+                count[y & 1] = 0;
+            };
+
+            for (int y = y0; y < y1; y++) {
+                const unsigned char *C = srcRow(y);
+                const unsigned char *Ctop = srcRow(y - 1);
+                const unsigned char *Cbottom = srcRow(y + 1);
+                unsigned char *out = dst.row(y);
+
+                // Most pixels are not blended, so we start with a plain copy (or
+                // with the average of both subsamples, for S2x and 4x):
+                if (!inPlace) {
+                    if (passes == 1)
+                        memcpy(out, C, rowSize);
+                    else
+                        averageSamplesRow<P>(C, out, width);
+                }
+
+                const unsigned short *V = nullptr, *Vtop = nullptr, *Vbottom = nullptr;
+                if (reprojection) {
+                    V = (const unsigned short *) velocity.row(y);
+                    Vtop = (const unsigned short *) velocity.row(max(y - 1, 0));
+                    Vbottom = (const unsigned short *) velocity.row(min(y + 1, height - 1));
+                    packVelocityRow(V, (unsigned int *) out, width);
+                }
+
+                // Calculates the final color of the subsample 'pass' of current
+                // pixel, given its blending weights:
+                auto blendPixel = [&](int pass, int x, unsigned int a) {
+                    auto sample = [&](const unsigned char *row, int x) { return P::load(row + P::size * (x * passes + pass)); };
+
+                    if (a == 0) {
+                        typename P::Value color = sample(C, x);
+                        if (reprojection)
+                            color = (color & 0x00ffffff) | (packVelocity(halfToFloat(V[2 * x]), halfToFloat(V[2 * x + 1])) << 24);
+                        return color;
+                    }
+
+                    int ax = a & 0xff, ay = (a >> 8) & 0xff, az = (a >> 16) & 0xff, aw = a >> 24;
+                    bool h = max(ax, az) > max(ay, aw); // max(horizontal) > max(vertical)
+
+                    // Unpack the weights from R8G8B8A8_UNORM:
+                    __m128 weights = _mm_mul_ps(unpack8(a), _mm_set1_ps(1.0f / 255.0f));
+
+                    // Calculate the blending offsets and weights:
+                    __m128 offset1, offset2;
+                    typename P::Value C1, C2;
+                    const unsigned short *V1 = nullptr, *V2 = nullptr;
+                    if (h) {
+                        offset1 = _mm_shuffle_ps(weights, weights, _MM_SHUFFLE(0, 0, 0, 0));
+                        offset2 = _mm_shuffle_ps(weights, weights, _MM_SHUFFLE(2, 2, 2, 2));
+                        C1 = sample(C, min(x + 1, width - 1));
+                        C2 = sample(C, max(x - 1, 0));
+                        if (reprojection) {
+                            V1 = V + 2 * min(x + 1, width - 1);
+                            V2 = V + 2 * max(x - 1, 0);
+                        }
+                    } else {
+                        offset1 = _mm_shuffle_ps(weights, weights, _MM_SHUFFLE(1, 1, 1, 1));
+                        offset2 = _mm_shuffle_ps(weights, weights, _MM_SHUFFLE(3, 3, 3, 3));
+                        C1 = sample(Cbottom, x);
+                        C2 = sample(Ctop, x);
+                        if (reprojection) {
+                            V1 = Vbottom + 2 * x;
+                            V2 = Vtop + 2 * x;
+                        }
+                    }
+                    __m128 sum = _mm_add_ps(offset1, offset2);
+                    __m128 weight1 = _mm_div_ps(offset1, sum);
+                    __m128 weight2 = _mm_div_ps(offset2, sum);
+
+                    // We exploit bilinear filtering to mix current pixel with the
+                    // chosen neighbor:
+                    __m128 color = P::unpack(sample(C, x));
+                    __m128 color1 = _mm_add_ps(color, _mm_mul_ps(offset1, _mm_sub_ps(P::unpack(C1), color)));
+                    __m128 color2 = _mm_add_ps(color, _mm_mul_ps(offset2, _mm_sub_ps(P::unpack(C2), color)));
+                    typename P::Value result = P::pack(_mm_add_ps(_mm_mul_ps(weight1, color1), _mm_mul_ps(weight2, color2)));
+
+                    if (reprojection) {
+                        // Antialias velocity for proper reprojection in a later
+                        // stage:
+                        float o1 = _mm_cvtss_f32(offset1), o2 = _mm_cvtss_f32(offset2);
+                        float w1 = _mm_cvtss_f32(weight1), w2 = _mm_cvtss_f32(weight2);
+                        float v[2];
+                        for (int c = 0; c < 2; c++) {
+                            float v0 = halfToFloat(V[2 * x + c]);
+                            float v1 = v0 + o1 * (halfToFloat(V1[c]) - v0);
+                            float v2 = v0 + o2 * (halfToFloat(V2[c]) - v0);
+                            v[c] = w1 * v1 + w2 * v2;
+                        }
+                        result = (result & 0x00ffffff) | (packVelocity(v[0], v[1]) << 24);
+                    }
+                    return result;
+                };
+
+                const unsigned int *b[2], *bBottom[2];
+                for (int pass = 0; pass < passes; pass++) {
+                    b[pass] = blend[pass] + size_t(y) * width;
+                    bBottom[pass] = blend[pass] + size_t(min(y + 1, height - 1)) * width;
+                }
+
+                for (int x = 0; x < width; x++) {
+                    // Fetch the blending weights for current pixel, for each
+                    // subsample:
+                    unsigned int a[2] = { 0, 0 };
+                    for (int pass = 0; pass < passes; pass++) {
+                        unsigned int right = b[pass][min(x + 1, width - 1)];
+                        a[pass] = (right >> 24) |                         // a.x: Right
+                                  (bBottom[pass][x] & 0x0000ff00) |       // a.y: Top
+                                  ((b[pass][x] >> 16 & 0xff) << 16) |     // a.z: Left
+                                  ((b[pass][x] & 0xff) << 24);            // a.w: Bottom
+                    }
+
+                    // Is there any blending weight with a value greater than 0.0?
+                    if ((a[0] | a[1]) == 0)
+                        continue;
+
+                    // The second subsample is blended with a factor of 0.5, as the
+                    // GPU would do when running the second pass:
+                    typename P::Value color;
+                    if (passes == 1)
+                        color = blendPixel(0, x, a[0]);
+                    else
+                        color = P::average(blendPixel(0, x, a[0]), blendPixel(1, x, a[1]));
+
+                    if (inPlace) {
+                        unsigned long long *w = writes[y & 1] + 2 * count[y & 1]++;
+                        w[0] = x;
+                        w[1] = color;
+                    } else
+                        P::store(out + P::size * x, color);
+                }
+
+                if (inPlace && y > y0)
+                    flush(y - 1);
+            }
+            if (inPlace)
+                flush(y1 - 1);
+        });
+    });
+}
+
+
+void SMAA::packVelocityRow(const unsigned short *velocity, unsigned int *out, int width) {
+    const __m128i mask = _mm_set1_epi32(0xffff);
+    const __m128i rgb = _mm_set1_epi32(0x00ffffff);
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (velocity + 2 * x));
+        __m128 vx = halfToFloat(_mm_and_si128(v, mask));
+        __m128 vy = halfToFloat(_mm_srli_epi32(v, 16));
+        __m128i a = _mm_slli_epi32(packVelocity(vx, vy), 24);
+        __m128i c = _mm_loadu_si128((const __m128i *) (out + x));
+        _mm_storeu_si128((__m128i *) (out + x), _mm_or_si128(_mm_and_si128(c, rgb), a));
+    }
+    for (; x < width; x++) {
+        unsigned int a = packVelocity(halfToFloat(velocity[2 * x]), halfToFloat(velocity[2 * x + 1]));
+        out[x] = (out[x] & 0x00ffffff) | (a << 24);
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+// YUV
+
+void SMAA::goYUV(const Image src[3], const Image dst[3], Mode mode) {
+    assert(src[0].format == Image::FORMAT_R8 && dst[0].format == Image::FORMAT_R8);
+    assert(mode != MODE_SMAA_S2X && mode != MODE_SMAA_4X && !reprojection);
+    for (int i = 1; i < 3; i++) {
+        assert(src[i].isValid() == src[1].isValid() && dst[i].isValid() == src[i].isValid());
+        assert(!src[i].isValid() || (src[i].format == Image::FORMAT_R8 && dst[i].format == Image::FORMAT_R8));
+        assert(!src[i].isValid() || (src[i].width == dst[i].width && src[i].height == dst[i].height));
+    }
+
+    go(src[0], Image(), Image(), dst[0], INPUT_LUMA, mode);
+    if (src[1].isValid())
+        chromaBlendingPass(src + 1, dst + 1);
+}
+
+
+/**
+ * Calculates how much of each neighbor (right, bottom, left and top) the
+ * neighborhood blending mixes into a pixel, given its blending weights 'a' as
+ * gathered in SMAA::neighborhoodBlendingPass. This is w1 * offset1 and
+ * w2 * offset2 there, as both lerps can be folded into:
+ *     C + w1 * offset1 * (C1 - C) + w2 * offset2 * (C2 - C)
+ */
+static inline void blendingCoefficients(unsigned int a, float c[4]) {
+    int ax = a & 0xff, ay = (a >> 8) & 0xff, az = (a >> 16) & 0xff, aw = a >> 24;
+    c[0] = c[1] = c[2] = c[3] = 0.0f;
+    if (max(ax, az) > max(ay, aw)) {
+        float sum = float(ax + az) * 255.0f;
+        c[0] = float(ax * ax) / sum;
+        c[2] = float(az * az) / sum;
+    } else {
+        float sum = float(ay + aw) * 255.0f;
+        c[1] = float(ay * ay) / sum;
+        c[3] = float(aw * aw) / sum;
+    }
+}
+
+
+void SMAA::chromaBlendingPass(const Image src[2], const Image dst[2]) {
+    const int chromaWidth = src[0].width, chromaHeight = src[0].height;
+    const int shiftX = chromaWidth < width? 1 : 0;
+    const int shiftY = chromaHeight < height? 1 : 0;
+    assert(chromaWidth == (width + shiftX) >> shiftX && chromaHeight == (height + shiftY) >> shiftY);
+    const int tasks = (chromaHeight + SMAA_ROWS_PER_TASK - 1) / SMAA_ROWS_PER_TASK;
+
+    // Start with a plain copy; when working in place, the copy is made to
+    // read the neighbors from instead:
+    Image in[2] = { src[0], src[1] }, copy[2] = { dst[0], dst[1] };
+    for (int i = 0; i < 2; i++) {
+        if (src[i].data == dst[i].data) {
+            unsigned char *chroma = carve(size_t(chromaWidth) * chromaHeight);
+            in[i] = copy[i] = Image(chroma, chromaWidth, chromaHeight, chromaWidth, Image::FORMAT_R8);
+        }
+    }
+    pool->parallelFor(tasks, [&](int task, int) {
+        int y0 = task * SMAA_ROWS_PER_TASK;
+        int y1 = min(y0 + SMAA_ROWS_PER_TASK, chromaHeight);
+        for (int i = 0; i < 2; i++)
+            for (int y = y0; y < y1; y++)
+                memcpy(copy[i].row(y), src[i].row(y), chromaWidth);
+    });
+
+    const unsigned int *b = blend[0];
+    pool->parallelFor(tasks, [&](int task, int) {
+        int y0 = task * SMAA_ROWS_PER_TASK;
+        int y1 = min(y0 + SMAA_ROWS_PER_TASK, chromaHeight);
+        for (int cy = y0; cy < y1; cy++) {
+            int ly0 = cy << shiftY, ly1 = min(ly0 + (1 << shiftY), height);
+            for (int cx = 0; cx < chromaWidth; cx++) {
+                int lx0 = cx << shiftX, lx1 = min(lx0 + (1 << shiftX), width);
+
+                // Only the blending across the borders of the chroma sample
+                // changes it; add up how much of each neighbor sample is
+                // mixed into the pixels it covers:
+                float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                bool any = false;
+                for (int y = ly0; y < ly1; y++) {
+                    const unsigned int *row = b + size_t(y) * width;
+                    const unsigned int *bottom = b + size_t(min(y + 1, height - 1)) * width;
+                    for (int x = lx0; x < lx1; x++) {
+                        // Same as in SMAA::neighborhoodBlendingPass:
+                        unsigned int a = (row[min(x + 1, width - 1)] >> 24) |
+                                         (bottom[x] & 0x0000ff00) |
+                                         ((row[x] >> 16 & 0xff) << 16) |
+                                         ((row[x] & 0xff) << 24);
+                        if (a == 0)
+                            continue;
+
+                        float c[4];
+                        blendingCoefficients(a, c);
+                        if (x == lx1 - 1) sum[0] += c[0];
+                        if (y == ly1 - 1) sum[1] += c[1];
+                        if (x == lx0) sum[2] += c[2];
+                        if (y == ly0) sum[3] += c[3];
+                        any = true;
+                    }
+                }
+                if (!any)
+                    continue;
+
+                float n = float((lx1 - lx0) * (ly1 - ly0));
+                for (int i = 0; i < 2; i++) {
+                    float C = in[i].row(cy)[cx];
+                    float N[4] = { float(in[i].row(cy)[min(cx + 1, chromaWidth - 1)]),
+                                   float(in[i].row(min(cy + 1, chromaHeight - 1))[cx]),
+                                   float(in[i].row(cy)[max(cx - 1, 0)]),
+                                   float(in[i].row(max(cy - 1, 0))[cx]) };
+                    float result = C;
+                    for (int j = 0; j < 4; j++)
+                        result += sum[j] / n * (N[j] - C);
+                    dst[i].row(cy)[cx] = (unsigned char) min(max(int(result + 0.5f), 0), 255);
+                }
+            }
+        }
+    });
+}
+
+
+//-----------------------------------------------------------------------------
+// Auxiliary planes
+
+void SMAA::goPlanes(const Image &src,
+                    const Image &depth,
+                    const Image &velocity,
+                    const Image &dst,
+                    const Image *planes,
+                    const Image *planeDsts,
+                    int count,
+                    Input input,
+                    Mode mode) {
+    for (int i = 0; i < count; i++) {
+        assert(planes[i].width == src.width && planes[i].height == src.height && planes[i].samples == src.samples);
+        assert(planeDsts[i].width == src.width && planeDsts[i].height == src.height);
+        assert(planeDsts[i].format == planes[i].format && planeDsts[i].samples == 1);
+        assert(planeDsts[i].data != planes[i].data);
+    }
+
+    go(src, depth, velocity, dst, input, mode);
+    if (count > 0)
+        planesBlendingPass(planes, planeDsts, count, (mode == MODE_SMAA_S2X || mode == MODE_SMAA_4X)? 2 : 1);
+}
+
+
+void SMAA::planesBlendingPass(const Image *planes, const Image *planeDsts, int count, int passes) {
+    const int tasks = (height + SMAA_ROWS_PER_TASK - 1) / SMAA_ROWS_PER_TASK;
+    PlaneBlend *blends = (PlaneBlend *) carve(sizeof(PlaneBlend) * width * pool->getThreadCount());
+
+    pool->parallelFor(tasks, [&](int task, int thread) {
+        int y0 = task * SMAA_ROWS_PER_TASK;
+        int y1 = min(y0 + SMAA_ROWS_PER_TASK, height);
+        PlaneBlend *row = blends + size_t(width) * thread;
+
+        for (int y = y0; y < y1; y++) {
+            // Work out the blended pixels of the row once, with the same math
+            // as SMAA::neighborhoodBlendingPass:
+            const unsigned int *b[2], *bBottom[2];
+            for (int pass = 0; pass < passes; pass++) {
+                b[pass] = blend[pass] + size_t(y) * width;
+                bBottom[pass] = blend[pass] + size_t(min(y + 1, height - 1)) * width;
+            }
+            int blended = 0;
+            for (int x = 0; x < width; x++) {
+                unsigned int a[2] = { 0, 0 };
+                for (int pass = 0; pass < passes; pass++) {
+                    unsigned int right = b[pass][min(x + 1, width - 1)];
+                    a[pass] = (right >> 24) |
+                              (bBottom[pass][x] & 0x0000ff00) |
+                              ((b[pass][x] >> 16 & 0xff) << 16) |
+                              ((b[pass][x] & 0xff) << 24);
+                }
+                if ((a[0] | a[1]) == 0)
+                    continue;
+
+                PlaneBlend &p = row[blended++];
+                p.x = x;
+                for (int pass = 0; pass < passes; pass++) {
+                    p.direction[pass] = -1;
+                    if (a[pass] == 0)
+                        continue;
+                    float ax = float(a[pass] & 0xff) * (1.0f / 255.0f), ay = float((a[pass] >> 8) & 0xff) * (1.0f / 255.0f);
+                    float az = float((a[pass] >> 16) & 0xff) * (1.0f / 255.0f), aw = float(a[pass] >> 24) * (1.0f / 255.0f);
+                    bool h = max(ax, az) > max(ay, aw);
+                    p.direction[pass] = h? 1 : 0;
+                    p.offset1[pass] = h? ax : ay;
+                    p.offset2[pass] = h? az : aw;
+                    float sum = p.offset1[pass] + p.offset2[pass];
+                    p.weight1[pass] = p.offset1[pass] / sum;
+                    p.weight2[pass] = p.offset2[pass] / sum;
+                }
+            }
+
+            // And apply them to every plane:
+            for (int i = 0; i < count; i++) {
+                withPlanePixel(planes[i].format, [&](auto pixel) {
+                    typedef decltype(pixel) P;
+                    const unsigned char *C = planes[i].row(y);
+                    const unsigned char *Ctop = planes[i].row(max(y - 1, 0));
+                    const unsigned char *Cbottom = planes[i].row(min(y + 1, height - 1));
+                    unsigned char *out = planeDsts[i].row(y);
+                    auto sample = [&](const unsigned char *row, int x, int pass) { return P::load(row + P::size * (x * passes + pass)); };
+
+                    if (passes == 1)
+                        memcpy(out, C, size_t(width) * P::size);
+                    else
+                        for (int x = 0; x < width; x++)
+                            P::store(out + P::size * x, P::average(sample(C, x, 0), sample(C, x, 1)));
+
+                    auto blendPixel = [&](const PlaneBlend &p, int pass) {
+                        typename P::Value C0 = sample(C, p.x, pass);
+                        if (p.direction[pass] < 0)
+                            return C0;
+                        typename P::Value C1, C2;
+                        if (p.direction[pass]) {
+                            C1 = sample(C, min(p.x + 1, width - 1), pass);
+                            C2 = sample(C, max(p.x - 1, 0), pass);
+                        } else {
+                            C1 = sample(Cbottom, p.x, pass);
+                            C2 = sample(Ctop, p.x, pass);
+                        }
+                        __m128 offset1 = _mm_set1_ps(p.offset1[pass]), offset2 = _mm_set1_ps(p.offset2[pass]);
+                        __m128 color = P::unpack(C0);
+                        __m128 color1 = _mm_add_ps(color, _mm_mul_ps(offset1, _mm_sub_ps(P::unpack(C1), color)));
+                        __m128 color2 = _mm_add_ps(color, _mm_mul_ps(offset2, _mm_sub_ps(P::unpack(C2), color)));
+                        return P::pack(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.weight1[pass]), color1),
+                                                  _mm_mul_ps(_mm_set1_ps(p.weight2[pass]), color2)));
+                    };
+                    for (int j = 0; j < blended; j++) {
+                        if (passes == 1)
+                            P::store(out + P::size * row[j].x, blendPixel(row[j], 0));
+                        else
+                            P::store(out + P::size * row[j].x, P::average(blendPixel(row[j], 0), blendPixel(row[j], 1)));
+                    }
+                });
+            }
+        }
+    });
+}
+
+
+//-----------------------------------------------------------------------------
+// Temporal resolve
+
+/**
+ * Same as SMAA::averageRow and SMAA::lerpRow, for the formats that can't be
+ * blended byte by byte.
+ */
+template <class P>
+static void lerpPixelsRow(const unsigned char *current, const unsigned char *previous, unsigned char *out, int width, float weight) {
+    __m128 w = _mm_set1_ps(weight);
+    for (int x = 0; x < width; x++) {
+        typename P::Value c = P::load(current + P::size * x), p = P::load(previous + P::size * x);
+        if (weight == 0.5f)
+            P::store(out + P::size * x, P::average(c, p));
+        else {
+            __m128 cf = P::unpack(c);
+            P::store(out + P::size * x, P::pack(_mm_add_ps(cf, _mm_mul_ps(w, _mm_sub_ps(P::unpack(p), cf)))));
+        }
+    }
+}
+
+
+void SMAA::reproject(const Image &current,
+                     const Image &previous,
+                     const Image &velocity,
+                     const Image &dst,
+                     float weight) {
+    assert(current.width == width && current.height == height && Image::isColor(current.format));
+    assert(previous.width == width && previous.height == height && previous.format == current.format);
+    assert(dst.width == width && dst.height == height && dst.format == current.format);
+    assert(!(reprojection && current.format != Image::FORMAT_RGBA8 && current.format != Image::FORMAT_BGRA8));
+    assert(!(reprojection && (!velocity.isValid() || velocity.format != Image::FORMAT_RG16F)));
+    assert(!(reprojection && dst.data == previous.data));
+    assert(weight >= 0.0f && weight <= 1.0f);
+
+    const int tasks = (height + SMAA_ROWS_PER_TASK - 1) / SMAA_ROWS_PER_TASK;
+    const int size = width * Image::bytesPerPixel(current.format);
+    // Formats made of 8-bit channels are blended byte by byte, unless they
+    // are sRGB:
+    const bool byteWise = current.format == Image::FORMAT_RGBA8 ||
+                          current.format == Image::FORMAT_BGRA8 ||
+                          current.format == Image::FORMAT_RGB8 ||
+                          current.format == Image::FORMAT_BGR8 ||
+                          current.format == Image::FORMAT_RGBX8;
+
+    pool->parallelFor(tasks, [&](int task, int) {
+        int y0 = task * SMAA_ROWS_PER_TASK;
+        int y1 = min(y0 + SMAA_ROWS_PER_TASK, height);
+        for (int y = y0; y < y1; y++) {
+            if (reprojection)
+                resolveRow(current, previous, velocity, dst, y, weight);
+            else if (!byteWise)
+                withPixel(current.format, [&](auto pixel) {
+                    lerpPixelsRow<decltype(pixel)>(current.row(y), previous.row(y), dst.row(y), width, weight);
+                });
+            else if (weight == 0.5f)
+                averageRow(current.row(y), previous.row(y), dst.row(y), size);
+            else
+                lerpRow(current.row(y), previous.row(y), dst.row(y), size, weight);
+        }
+    });
+}
+
+
+void SMAA::averageRow(const unsigned char *current, const unsigned char *previous, unsigned char *out, int size) {
+    // Just blend the bytes, whatever the 8-bit format is; this is pure
+    // bandwidth, so go as wide as we can:
+    int i = 0;
+    #ifdef SMAA_AVX2
+    for (; i + 32 <= size; i += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i *) (current + i));
+        __m256i p = _mm256_loadu_si256((const __m256i *) (previous + i));
+        _mm256_storeu_si256((__m256i *) (out + i), _mm256_avg_epu8(c, p));
+    }
+    #endif
+    for (; i + 16 <= size; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i *) (current + i));
+        __m128i p = _mm_loadu_si128((const __m128i *) (previous + i));
+        _mm_storeu_si128((__m128i *) (out + i), _mm_avg_epu8(c, p));
+    }
+    for (; i < size; i++)
+        out[i] = (unsigned char) ((current[i] + previous[i] + 1) >> 1);
+}
+
+
+void SMAA::lerpRow(const unsigned char *current, const unsigned char *previous, unsigned char *out, int size, float weight) {
+    // out = current + (previous - current) * weight, with a 7-bit fixed point
+    // weight so that the signed product still fits in 16 bits:
+    int w = int(weight * 128.0f + 0.5f);
+    int i = 0;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i factor = _mm_set1_epi16(short(w));
+    const __m128i round = _mm_set1_epi16(64);
+    auto lerp = [&](__m128i c, __m128i p) {
+        __m128i d = _mm_mullo_epi16(_mm_sub_epi16(p, c), factor);
+        return _mm_add_epi16(c, _mm_srai_epi16(_mm_add_epi16(d, round), 7));
+    };
+    for (; i + 16 <= size; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i *) (current + i));
+        __m128i p = _mm_loadu_si128((const __m128i *) (previous + i));
+        __m128i lo = lerp(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(p, zero));
+        __m128i hi = lerp(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(p, zero));
+        _mm_storeu_si128((__m128i *) (out + i), _mm_packus_epi16(lo, hi));
+    }
+    for (; i < size; i++) {
+        int c = current[i], p = previous[i];
+        out[i] = (unsigned char) (c + (((p - c) * w + 64) >> 7));
+    }
+}
+
+
+/**
+ * This is SMAAResolvePS with reprojection. The previous frame is fetched with
+ * bilinear filtering (the shader point samples it), which is the same for
+ * whole pixel displacements and avoids snapping subpixel motion.
+ */
+void SMAA::resolveRow(const Image &current, const Image &previous, const Image &velocity, const Image &dst, int y, float weight) {
+    const unsigned int *C = (const unsigned int *) current.row(y);
+    const unsigned short *V = (const unsigned short *) velocity.row(y);
+    unsigned int *out = (unsigned int *) dst.row(y);
+
+    int x = 0;
+    #ifdef SMAA_AVX2
+    const unsigned char *P = (const unsigned char *) previous.data;
+    const __m256 maxWeight = _mm256_set1_ps(weight);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    const __m256i maxX = _mm256_set1_epi32(width - 1), maxY = _mm256_set1_epi32(height - 1);
+    const __m256i pitch = _mm256_set1_epi32(previous.pitch);
+    const __m256i zero = _mm256_setzero_si256();
+
+    auto channel = [&](__m256i c, int i) {
+        return _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(c, 8 * i), mask));
+    };
+
+    for (; x + 8 <= width; x += 8) {
+        // Velocity is assumed to be calculated for motion blur, so we need to
+        // inverse it for reprojection. Split the R16G16_FLOAT pairs into two
+        // runs of 8 halves first:
+        __m256i v = _mm256_loadu_si256((const __m256i *) (V + 2 * x));
+        v = _mm256_packus_epi32(_mm256_and_si256(v, _mm256_set1_epi32(0xffff)), _mm256_srli_epi32(v, 16));
+        v = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0));
+        __m256 vx = _mm256_cvtph_ps(_mm256_castsi256_si128(v));
+        __m256 vy = _mm256_cvtph_ps(_mm256_extracti128_si256(v, 1));
+
+        // Reproject current coordinates (texel centers are at +0.5, and we
+        // subtract it again for bilinear filtering):
+        __m256 px = _mm256_add_ps(_mm256_set1_ps(float(x)), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+        __m256 py = _mm256_set1_ps(float(y));
+        px = _mm256_sub_ps(px, _mm256_mul_ps(vx, _mm256_set1_ps(float(width))));
+        py = _mm256_sub_ps(py, _mm256_mul_ps(vy, _mm256_set1_ps(float(height))));
+        __m256 fx0 = _mm256_floor_ps(px), fy0 = _mm256_floor_ps(py);
+        __m256 fx = _mm256_sub_ps(px, fx0), fy = _mm256_sub_ps(py, fy0);
+
+        // Clamp addressing:
+        __m256i x0 = _mm256_cvtps_epi32(fx0), y0 = _mm256_cvtps_epi32(fy0);
+        __m256i x1 = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(x0, _mm256_set1_epi32(1)), zero), maxX);
+        __m256i y1 = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(y0, _mm256_set1_epi32(1)), zero), maxY);
+        x0 = _mm256_min_epi32(_mm256_max_epi32(x0, zero), maxX);
+        y0 = _mm256_min_epi32(_mm256_max_epi32(y0, zero), maxY);
+        x0 = _mm256_slli_epi32(x0, 2);
+        x1 = _mm256_slli_epi32(x1, 2);
+        y0 = _mm256_mullo_epi32(y0, pitch);
+        y1 = _mm256_mullo_epi32(y1, pitch);
+
+        // Fetch the four texels around the reprojected position:
+        __m256i t00 = _mm256_i32gather_epi32((const int *) P, _mm256_add_epi32(y0, x0), 1);
+        __m256i t10 = _mm256_i32gather_epi32((const int *) P, _mm256_add_epi32(y0, x1), 1);
+        __m256i t01 = _mm256_i32gather_epi32((const int *) P, _mm256_add_epi32(y1, x0), 1);
+        __m256i t11 = _mm256_i32gather_epi32((const int *) P, _mm256_add_epi32(y1, x1), 1);
+        __m256i c = _mm256_loadu_si256((const __m256i *) (C + x));
+
+        __m256 prev[4], curr[4];
+        for (int i = 0; i < 4; i++) {
+            __m256 a = channel(t00, i), b = channel(t10, i);
+            __m256 top = _mm256_add_ps(a, _mm256_mul_ps(fx, _mm256_sub_ps(b, a)));
+            a = channel(t01, i), b = channel(t11, i);
+            __m256 bottom = _mm256_add_ps(a, _mm256_mul_ps(fx, _mm256_sub_ps(b, a)));
+            prev[i] = _mm256_add_ps(top, _mm256_mul_ps(fy, _mm256_sub_ps(bottom, top)));
+            curr[i] = channel(c, i);
+        }
+
+        // Attenuate the previous pixel if the velocity is different:
+        __m256 scale = _mm256_set1_ps(1.0f / (255.0f * 255.0f * 5.0f));
+        __m256 delta = _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(curr[3], curr[3]), _mm256_mul_ps(prev[3], prev[3])), scale);
+        delta = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), delta);
+        __m256 w = _mm256_sub_ps(one, _mm256_mul_ps(_mm256_sqrt_ps(delta), _mm256_set1_ps(SMAA_REPROJECTION_WEIGHT_SCALE)));
+        w = _mm256_mul_ps(maxWeight, _mm256_min_ps(_mm256_max_ps(w, _mm256_setzero_ps()), one));
+
+        // Blend the pixels according to the calculated weight:
+        __m256i result = _mm256_setzero_si256();
+        for (int i = 0; i < 4; i++) {
+            __m256 blended = _mm256_add_ps(curr[i], _mm256_mul_ps(w, _mm256_sub_ps(prev[i], curr[i])));
+            result = _mm256_or_si256(result, _mm256_slli_epi32(_mm256_cvtps_epi32(blended), 8 * i));
+        }
+        _mm256_storeu_si256((__m256i *) (out + x), result);
+    }
+    #else
+    const __m128 maxWeight = _mm_set1_ps(weight);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128i mask = _mm_set1_epi32(0xff);
+    const __m128 maxX = _mm_set1_ps(float(width - 1)), maxY = _mm_set1_ps(float(height - 1));
+    const __m128 zero = _mm_setzero_ps();
+
+    auto channel = [&](__m128i c, int i) {
+        return _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(c, 8 * i), mask));
+    };
+
+    // SSE2 has no floor, so truncate and step down the negative fractions:
+    auto floor4 = [&](__m128 v) {
+        __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+        return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, v), one));
+    };
+
+    // Nor gathers; the texels are fetched one by one:
+    alignas(16) int x0[4], x1[4], y0[4], y1[4];
+    auto fetch = [&](const int *ys, const int *xs) {
+        return _mm_setr_epi32(((const int *) previous.row(ys[0]))[xs[0]], ((const int *) previous.row(ys[1]))[xs[1]],
+                              ((const int *) previous.row(ys[2]))[xs[2]], ((const int *) previous.row(ys[3]))[xs[3]]);
+    };
+
+    for (; x + 4 <= width; x += 4) {
+        // Velocity is assumed to be calculated for motion blur, so we need to
+        // inverse it for reprojection:
+        __m128i v = _mm_loadu_si128((const __m128i *) (V + 2 * x));
+        __m128 vx = halfToFloat(_mm_and_si128(v, _mm_set1_epi32(0xffff)));
+        __m128 vy = halfToFloat(_mm_srli_epi32(v, 16));
+
+        // Reproject current coordinates (texel centers are at +0.5, and we
+        // subtract it again for bilinear filtering):
+        __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+        __m128 py = _mm_set1_ps(float(y));
+        px = _mm_sub_ps(px, _mm_mul_ps(vx, _mm_set1_ps(float(width))));
+        py = _mm_sub_ps(py, _mm_mul_ps(vy, _mm_set1_ps(float(height))));
+        __m128 fx0 = floor4(px), fy0 = floor4(py);
+        __m128 fx = _mm_sub_ps(px, fx0), fy = _mm_sub_ps(py, fy0);
+
+        // Clamp addressing, in floats, as SSE2 has no 32-bit integer min and
+        // max either:
+        _mm_store_si128((__m128i *) x0, _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(fx0, zero), maxX)));
+        _mm_store_si128((__m128i *) x1, _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(fx0, one), zero), maxX)));
+        _mm_store_si128((__m128i *) y0, _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(fy0, zero), maxY)));
+        _mm_store_si128((__m128i *) y1, _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(fy0, one), zero), maxY)));
+
+        // Fetch the four texels around the reprojected position:
+        __m128i t00 = fetch(y0, x0), t10 = fetch(y0, x1), t01 = fetch(y1, x0), t11 = fetch(y1, x1);
+        __m128i c = _mm_loadu_si128((const __m128i *) (C + x));
+
+        __m128 prev[4], curr[4];
+        for (int i = 0; i < 4; i++) {
+            __m128 a = channel(t00, i), b = channel(t10, i);
+            __m128 top = _mm_add_ps(a, _mm_mul_ps(fx, _mm_sub_ps(b, a)));
+            a = channel(t01, i), b = channel(t11, i);
+            __m128 bottom = _mm_add_ps(a, _mm_mul_ps(fx, _mm_sub_ps(b, a)));
+            prev[i] = _mm_add_ps(top, _mm_mul_ps(fy, _mm_sub_ps(bottom, top)));
+            curr[i] = channel(c, i);
+        }
+
+        // Attenuate the previous pixel if the velocity is different:
+        __m128 scale = _mm_set1_ps(1.0f / (255.0f * 255.0f * 5.0f));
+        __m128 delta = abs_ps(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(curr[3], curr[3]), _mm_mul_ps(prev[3], prev[3])), scale));
+        __m128 w = _mm_sub_ps(one, _mm_mul_ps(_mm_sqrt_ps(delta), _mm_set1_ps(SMAA_REPROJECTION_WEIGHT_SCALE)));
+        w = _mm_mul_ps(maxWeight, _mm_min_ps(_mm_max_ps(w, zero), one));
+
+        // Blend the pixels according to the calculated weight:
+        __m128i result = _mm_setzero_si128();
+        for (int i = 0; i < 4; i++) {
+            __m128 blended = _mm_add_ps(curr[i], _mm_mul_ps(w, _mm_sub_ps(prev[i], curr[i])));
+            result = _mm_or_si128(result, _mm_slli_epi32(_mm_cvtps_epi32(blended), 8 * i));
+        }
+        _mm_storeu_si128((__m128i *) (out + x), result);
+    }
+    #endif
+
+    for (; x < width; x++) {
+        float px = float(x) - halfToFloat(V[2 * x]) * width;
+        float py = float(y) - halfToFloat(V[2 * x + 1]) * height;
+        float fx0 = floor(px), fy0 = floor(py);
+        __m128 fx = _mm_set1_ps(px - fx0), fy = _mm_set1_ps(py - fy0);
+        int x0 = int(fx0), y0 = int(fy0);
+        int x1 = min(max(x0 + 1, 0), width - 1), y1 = min(max(y0 + 1, 0), height - 1);
+        x0 = min(max(x0, 0), width - 1);
+        y0 = min(max(y0, 0), height - 1);
+
+        const unsigned int *P0 = (const unsigned int *) previous.row(y0);
+        const unsigned int *P1 = (const unsigned int *) previous.row(y1);
+        __m128 top = unpack8(P0[x0]), bottom = unpack8(P1[x0]);
+        top = _mm_add_ps(top, _mm_mul_ps(fx, _mm_sub_ps(unpack8(P0[x1]), top)));
+        bottom = _mm_add_ps(bottom, _mm_mul_ps(fx, _mm_sub_ps(unpack8(P1[x1]), bottom)));
+        __m128 prev = _mm_add_ps(top, _mm_mul_ps(fy, _mm_sub_ps(bottom, top)));
+        __m128 curr = unpack8(C[x]);
+
+        float pa = _mm_cvtss_f32(_mm_shuffle_ps(prev, prev, _MM_SHUFFLE(3, 3, 3, 3))) / 255.0f;
+        float ca = float(C[x] >> 24) / 255.0f;
+        float delta = abs(ca * ca - pa * pa) / 5.0f;
+        float w = weight * min(max(1.0f - sqrt(delta) * SMAA_REPROJECTION_WEIGHT_SCALE, 0.0f), 1.0f);
+
+        out[x] = pack8(_mm_add_ps(curr, _mm_mul_ps(_mm_set1_ps(w), _mm_sub_ps(prev, curr))));
+    }
+}
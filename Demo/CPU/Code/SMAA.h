@@ -0,0 +1,614 @@
+/**
+ * Copyright (C) 2013 Jorge Jimenez (jorge@iryoku.com)
+ * Copyright (C) 2013 Jose I. Echevarria (joseignacioechevarria@gmail.com)
+ * Copyright (C) 2013 Belen Masia (bmasia@unizar.es)
+ * Copyright (C) 2013 Fernando Navarro (fernandn@microsoft.com)
+ * Copyright (C) 2013 Diego Gutierrez (diegog@unizar.es)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software. As clarification, there
+ * is no requirement that the copyright notice and permission be included in
+ * binary distributions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef SMAA_H
+#define SMAA_H
+
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+#include "Image.h"
+#include "ThreadPool.h"
+
+/**
+ * IMPORTANT NOTICE: please note that the documentation given in this file is
+ * rather limited. We recommend first checking out SMAA.hlsl in the root
+ * directory of the source release (the shader header), then coming back here.
+ * This is a CPU port of the shader, which follows it as closely as possible
+ * (look for the shader function names in the implementation), so that
+ * |edgesTex| and |blendTex| can be validated against the GPU ones.
+ */
+
+
+class SMAA {
+    public:
+        class SubsamplePattern;
+        class Plan;
+        class Job;
+        class Rect;
+
+        enum Mode { MODE_SMAA_1X, MODE_SMAA_T2X, MODE_SMAA_S2X, MODE_SMAA_4X, MODE_SMAA_CUSTOM, MODE_SMAA_COUNT=MODE_SMAA_CUSTOM };
+        enum Preset { PRESET_LOW, PRESET_MEDIUM, PRESET_HIGH, PRESET_ULTRA, PRESET_CUSTOM, PRESET_COUNT=PRESET_CUSTOM };
+        enum Input { INPUT_LUMA, INPUT_COLOR, INPUT_DEPTH, INPUT_COUNT=INPUT_DEPTH };
+
+        /**
+         * @EXTERNAL_STORAGE
+         *
+         * All the intermediate buffers are carved out of a single region of
+         * memory, at 64-byte boundaries, in the same order on every frame; no
+         * memory is allocated while running. By default the object allocates
+         * it, and reallocates it only when a larger size or a mode with more
+         * passes is first used.
+         *
+         * If you have spare memory, like a pool of huge pages, pass it to
+         * SMAA::SMAA() using an ExternalStorage object. 'data' must be aligned
+         * to 64 bytes, and 'size' must be at least getStorageSize() for the
+         * largest size and mode that will be used, and the threads of the
+         * object's pool. It is not freed by the object. A smaller size is
+         * reported on stderr and aborts, in release builds too, as soon as
+         * it is found (at construction for the size given there).
+         *
+         * Otherwise, 'hugePages' asks for the region the object allocates to
+         * be backed by transparent huge pages, where the system supports
+         * them. Either way, it is touched by all the threads of the pool as
+         * soon as it is allocated, so that the page faults don't happen in
+         * the middle of a frame.
+         */
+        class ExternalStorage {
+            public:
+                ExternalStorage(void *data=nullptr, size_t size=0, bool hugePages=false)
+                    : data(data),
+                      size(size),
+                      hugePages(hugePages) {}
+
+            void *data;
+            size_t size;
+            bool hugePages;
+        };
+
+        static size_t getStorageSize(int width, int height, int threads, Mode mode=MODE_SMAA_1X);
+
+        /**
+         * By default, the intermediate buffers (|edgesTex|, |blendTex| and the
+         * scratch rows of each thread) are allocated here, for the given
+         * size. If you have spare memory, search for @EXTERNAL_STORAGE.
+         *
+         * If 'pool' is nullptr, a pool with one thread per core is created
+         * for this object.
+         */
+        SMAA(int width, int height,
+             Preset preset=PRESET_HIGH, bool predication=false, bool reprojection=false,
+             ThreadPool *pool=nullptr,
+             const ExternalStorage &storage=ExternalStorage());
+        ~SMAA();
+
+        /**
+         * Mandatory input images varies depending on 'input':
+         *    INPUT_LUMA:
+         *    INPUT_COLOR:
+         *        go(src, depth,   velocity, dst)
+         *    INPUT_DEPTH:
+         *        go(src, depth,   velocity, dst)
+         *
+         * 'src' and 'dst' must be FORMAT_RGBA8 images of the size the object
+         * was created with, and must not overlap. 'depth' must be FORMAT_R32F,
+         * and can be left empty (Image()) if neither depth edge detection nor
+         * predication are used.
+         *
+         * 'velocity' must be FORMAT_RG16F, in texture coordinates units (as in
+         * the shader), and is only needed if reprojection is enabled. In that
+         * case the output alpha holds the packed velocity that reproject()
+         * needs later on.
+         *
+         * For MODE_SMAA_T2X, 'src' must have been rendered with the jitter
+         * given by getJitter(), and the output resolved with the previous
+         * frame using reproject(). See TemporalSMAA.h, which does all this.
+         *
+         * 'src' and 'dst' can be in any of the color formats (see Image.h),
+         * as long as they are the same. 'dst' can be 'src' itself, in which
+         * case only the blended pixels are written (this is not possible for
+         * S2x and 4x, nor with reprojection). Reprojection needs an 8-bit
+         * alpha for the velocity: FORMAT_RGBA8 or FORMAT_BGRA8.
+         *
+         * The _SRGB formats are blended in linear space, as the DX10 demo does
+         * reading 'srcSRV'; the edge detection still reads the gamma values,
+         * as from 'srcGammaSRV' there.
+         *
+         * For MODE_SMAA_S2X and MODE_SMAA_4X, 'src' must be a 2x multisampled
+         * image (see Image.h), and 'depth' and 'velocity' are the resolved
+         * ones. There is no need to separate the subsamples: both passes are
+         * run at the same time, reading them directly from 'src', and the
+         * average of the two is written to 'dst' in the last pass.
+         *
+         * MODE_SMAA_CUSTOM works as MODE_SMAA_T2X, but using the subsample
+         * pattern given to setSubsamplePattern (see @SUBSAMPLE_PATTERN).
+         *
+         * 'src' can also be a single FORMAT_R8 plane, which is taken as luma
+         * (see goYUV).
+         */
+        void go(const Image &src, // Input color image, in gamma space.
+                const Image &depth, // Input depth image.
+                const Image &velocity, // Input velocity image, if reproject is going to be called later on, Image() otherwise.
+                const Image &dst, // Output image.
+                Input input, // Selects the input for edge detection.
+                Mode mode=MODE_SMAA_1X); // Selects the SMAA mode.
+
+        /**
+         * @PLAN
+         *
+         * Everything go() derives from the image size, format, preset and
+         * input (the parameters, the row bands, the halo, the layout of the
+         * scratch rows and the row loader for the format) is worked out once,
+         * into a plan. Plans are immutable, so they are shared among objects
+         * and threads, and the most recently used ones are kept in a small
+         * cache; objects created for a size seen before find theirs ready.
+         *
+         * getPlan() returns the plan go() would use for 'src', with the preset
+         * and parameters of this object. It can be kept and passed to go()
+         * directly, which then resizes the object to the size of the plan
+         * (see resize), so that one object can take images of any size.
+         */
+        std::shared_ptr<const Plan> getPlan(const Image &src, Input input);
+        void go(const Plan &plan,
+                const Image &src,
+                const Image &depth,
+                const Image &velocity,
+                const Image &dst,
+                Mode mode=MODE_SMAA_1X);
+
+        /**
+         * @INCREMENTAL
+         *
+         * For frames that mostly repeat the previous one, like desktop or UI
+         * captures: only the rectangles of 'src' listed in 'dirty' changed
+         * since the frame whose output is 'previous'. Each rectangle is grown
+         * by getHalo(), the farthest a changed pixel can affect the output,
+         * and antialiased again (along with another halo of neighbors, so
+         * that the result is exactly that of go()); the rest of 'dst' is
+         * taken from 'previous', which can be 'dst' itself, so that the cost
+         * follows the changes instead of the resolution. 'dst' can't be
+         * 'src', and reprojection is not supported.
+         *
+         * The regions and their output are carved from the arena as well, so
+         * external storage needs width * height * bytes per pixel of 'dst',
+         * plus 16 bytes per rectangle, over getStorageSize().
+         */
+        void goIncremental(const Image &src,
+                           const Image &depth,
+                           const Image &previous,
+                           const Image &dst,
+                           const Rect *dirty, int count,
+                           Input input,
+                           Mode mode=MODE_SMAA_1X);
+
+        /**
+         * @TILE_CACHE
+         *
+         * Same as goIncremental, for callers that don't know what changed,
+         * like renderers with a static camera: the frame is split in tiles
+         * of 64x64 pixels, whose inputs (source, depth if it is used, and
+         * mask) are hashed and compared with the ones of the previous call.
+         * Only the tiles that changed are antialiased again, along with their
+         * halo, and the rest of the output is kept.
+         *
+         * 'dst' must hold the output of the previous call, which is the case
+         * when each frame is antialiased into the same image; a different
+         * 'dst', or a change of size, format, input, mode or parameters,
+         * antialiases the whole frame again. 'dst' can't be 'src', and
+         * reprojection is not supported.
+         */
+        void goCached(const Image &src,
+                      const Image &depth,
+                      const Image &dst,
+                      Input input,
+                      Mode mode=MODE_SMAA_1X);
+
+        /**
+         * @SCANLINE
+         *
+         * Same as go(), but delivers the output as it is done, top to bottom:
+         * rowsReady(y0, y1) is called, on the calling thread, as soon as rows
+         * [y0, y1) of 'dst' are final, and won't be touched anymore. Edges and
+         * weights are only calculated as far ahead as the searches need to
+         * finish those rows (see getHalo), so the first rows are ready after
+         * a small fraction of the frame, for display or capture paths that
+         * can start sending them. The rows of each call are as many row bands
+         * as threads in the pool.
+         */
+        void goScanline(const Image &src,
+                        const Image &depth,
+                        const Image &velocity,
+                        const Image &dst,
+                        Input input,
+                        const std::function<void(int, int)> &rowsReady,
+                        Mode mode=MODE_SMAA_1X);
+
+        /**
+         * @ASYNC
+         *
+         * go() blocks until the whole image is done. For frame loops that
+         * can't afford that, start() takes the same arguments, sets up the
+         * intermediate buffers, and returns a job that does the actual work
+         * in slices (one row band per thread of the pool) each time step()
+         * is called. step() runs slices until 'budget' milliseconds are
+         * spent, not starting one it expects to go over (but always at least
+         * one), and returns true once the image is done. A coroutine job
+         * system can wrap it in an awaitable, resumed with the time left in
+         * each frame:
+         *
+         *     auto job = smaa.start(src, depth, velocity, dst, SMAA::INPUT_LUMA);
+         *     while (!job->step(2.0))
+         *         co_await nextFrame();
+         *
+         * run() instead finishes the job on the background thread of the
+         * pool (see ThreadPool::submit), and returns a future, which holds
+         * false if the job was cancelled. Either way, the passes run on the
+         * pool of the object.
+         *
+         * cancel() can be called from any thread, and stops the job before
+         * the next slice, leaving 'dst' (and 'src', in place) half done. The
+         * object must not be used for anything else until its job is done or
+         * cancelled, and the images must be kept alive as well.
+         */
+        std::shared_ptr<Job> start(const Image &src,
+                                   const Image &depth,
+                                   const Image &velocity,
+                                   const Image &dst,
+                                   Input input,
+                                   Mode mode=MODE_SMAA_1X);
+
+        class Job : public std::enable_shared_from_this<Job> {
+            public:
+                bool step(double budget);
+                std::future<bool> run();
+
+                void cancel() { cancelled = true; }
+                bool isCancelled() const { return cancelled; }
+                bool isDone() const { return phase == PHASE_DONE; }
+
+            private:
+                friend class SMAA;
+                enum Phase { PHASE_EDGES, PHASE_WEIGHTS, PHASE_BLENDING, PHASE_DONE };
+
+                Job(SMAA *smaa, std::shared_ptr<const Plan> plan,
+                    const Image &src, const Image &depth, const Image &velocity, const Image &dst,
+                    Mode mode, int passes);
+
+                SMAA *smaa;
+                std::shared_ptr<const Plan> plan;
+                Image src, depth, velocity, dst;
+                Mode mode;
+                int passes;
+
+                // Next band to run of the current pass, and running average of
+                // the time a slice takes, in milliseconds:
+                Phase phase;
+                int next;
+                double sliceTime;
+
+                std::atomic<bool> cancelled;
+        };
+
+        /**
+         * @YUV
+         *
+         * Antialiases a planar YUV frame without converting it to RGB. 'src'
+         * and 'dst' hold the Y, U and V planes, as FORMAT_R8 images. Edges
+         * are detected on the Y plane, which already is luma (so the input
+         * is always INPUT_LUMA), and the blending weights are applied to it
+         * at full resolution.
+         *
+         * The chroma planes can be subsampled (4:2:0 or 4:2:2), and are left
+         * empty (Image()) for monochrome frames. They are blended at their own
+         * resolution, with weights derived from the ones of the pixels that
+         * each chroma sample covers: only the blending across the borders of
+         * the sample changes it.
+         *
+         * As with go(), 'dst' can be 'src'. S2x and 4x are not supported.
+         */
+        void goYUV(const Image src[3], const Image dst[3], Mode mode=MODE_SMAA_1X);
+
+        /**
+         * @PLANES
+         *
+         * Antialiases 'src' into 'dst' as go() does, and then blends 'count'
+         * auxiliary planes, like the AOVs of a renderer (diffuse, specular,
+         * normals...), exactly as the color was, so that they stay consistent
+         * with it: planes[i] is blended into planeDsts[i]. Edges and weights
+         * are only calculated once, and the planes are blended together in a
+         * single pass, which works out how each pixel is mixed just once for
+         * all of them.
+         *
+         * The planes can be in any color format, FORMAT_R8, FORMAT_R32F or
+         * FORMAT_RG16F, with the size and samples of 'src'. Each output must
+         * have the format of its plane and a single sample, and can't be the
+         * plane itself. Planes holding values that can't be mixed, like object
+         * ids, are better left out.
+         */
+        void goPlanes(const Image &src,
+                      const Image &depth,
+                      const Image &velocity,
+                      const Image &dst,
+                      const Image *planes,
+                      const Image *planeDsts,
+                      int count,
+                      Input input,
+                      Mode mode=MODE_SMAA_1X);
+
+        /**
+         * This function perform a temporal resolve of two images. They must
+         * contain temporary jittered color subsamples. 'velocity' is only
+         * needed if reprojection is enabled; otherwise, both images are just
+         * averaged.
+         *
+         * 'weight' is the weight of the previous image (before velocity
+         * weighting); use values above 0.5 for accumulating more than two
+         * frames into 'previous'. 'dst' can be 'current', but not 'previous'.
+         * The three images must be in the same format, as output by go().
+         */
+        void reproject(const Image &current,
+                       const Image &previous,
+                       const Image &velocity,
+                       const Image &dst,
+                       float weight=0.5f);
+
+        /**
+         * Maps each subsample of the 2x multisampled input to the subsample
+         * indices, see SMAA::detectMSAAOrder in the DX10 demo. By default,
+         * D3D10_STANDARD_MULTISAMPLE_PATTERN is assumed: sample 0 is the
+         * right-bottom one, and sample 1 the left-top one (y pointing down).
+         * Use setMSAAOrder(1, 0) if it's the other way around.
+         */
+        int msaaReorder(int sample) const { return msaaOrderMap[sample]; }
+        void setMSAAOrder(int sample0, int sample1) { msaaOrderMap[0] = sample0; msaaOrderMap[1] = sample1; }
+
+        /**
+         * Gets the image size the object operates on.
+         */
+        int getWidth() const { return width; }
+        int getHeight() const { return height; }
+
+        /**
+         * Changes the image size the object operates on. The intermediate
+         * buffers only grow, so an object can be reused for images of
+         * different sizes without reallocating (see BatchSMAA.h).
+         */
+        void resize(int width, int height);
+
+        /**
+         * Selects the preset given to the constructor.
+         */
+        Preset getPreset() const { return preset; }
+        void setPreset(Preset preset) { this->preset = preset; }
+
+        /**
+         * Threshold for the edge detection. Only has effect if PRESET_CUSTOM
+         * is selected.
+         */
+        float getThreshold() const { return threshold; }
+        void setThreshold(float threshold) { this->threshold = threshold; }
+
+        /**
+         * Maximum length to search for horizontal/vertical patterns. Each step
+         * is two pixels wide. Only has effect if PRESET_CUSTOM is selected.
+         */
+        int getMaxSearchSteps() const { return maxSearchSteps; }
+        void setMaxSearchSteps(int maxSearchSteps) { this->maxSearchSteps = maxSearchSteps; }
+
+        /**
+         * Maximum length to search for diagonal patterns. Only has effect if
+         * PRESET_CUSTOM is selected.
+         */
+        int getMaxSearchStepsDiag() const { return maxSearchStepsDiag; }
+        void setMaxSearchStepsDiag(int maxSearchStepsDiag) { this->maxSearchStepsDiag = maxSearchStepsDiag; }
+
+        /**
+         * Desired corner rounding, from 0.0 (no rounding) to 100.0 (full
+         * rounding). Only has effect if PRESET_CUSTOM is selected.
+         */
+        float getCornerRounding() const { return cornerRounding; }
+        void setCornerRounding(float cornerRounding) { this->cornerRounding = cornerRounding; }
+
+        /**
+         * Distance, in pixels, beyond which pixels don't affect each other's
+         * result with the current parameters: the search distances plus the
+         * reach of the edge detection and blending. An image surrounded by
+         * this many copies of its border pixels is antialiased exactly as if
+         * it was alone (see BatchSMAA::goAtlas).
+         */
+        int getHalo() const;
+
+        /**
+         * Subpixel offset, in pixels, that must be applied to the projection
+         * of the frame that is going to be rendered next. Use
+         *     2.0 * jitter[0] / width, 2.0 * jitter[1] / height
+         * for translating the projected positions (see JitteredMatrix in the
+         * DX10 demo).
+         */
+        void getJitter(Mode mode, float jitter[2]) const;
+
+        /**
+         * Increases the subpixel counter.
+         */
+        void nextFrame();
+        int getFrameIndex() const { return frameIndex; }
+
+        /**
+         * @SUBSAMPLE_PATTERN
+         *
+         * SMAA T2x and 4x use fixed subsample positions, which have their own
+         * slots in the area texture. For supersampling with other temporal
+         * sequences, like 8 points of a Halton sequence, each subsample
+         * position needs extra slots. Scripts/AreaTex.py generates them:
+         *     AreaTex.py --jitter halton --samples 8
+         * It outputs an area texture with the extra slots, along with the
+         * jitters and subsample indices of each frame; pass them here, and
+         * use MODE_SMAA_CUSTOM. The arrays are not copied.
+         */
+        class SubsamplePattern {
+            public:
+                SubsamplePattern(int count=0,
+                                 const float (*jitters)[2]=nullptr,
+                                 const float (*subsampleIndices)[4]=nullptr,
+                                 const unsigned char *areaTexBytes=nullptr,
+                                 int areaTexHeight=0)
+                    : count(count),
+                      jitters(jitters),
+                      subsampleIndices(subsampleIndices),
+                      areaTexBytes(areaTexBytes),
+                      areaTexHeight(areaTexHeight) {}
+
+            int count;
+            const float (*jitters)[2];
+            const float (*subsampleIndices)[4];
+            const unsigned char *areaTexBytes;
+            int areaTexHeight;
+        };
+
+        void setSubsamplePattern(const SubsamplePattern &pattern);
+        const SubsamplePattern &getSubsamplePattern() const { return pattern; }
+
+        /**
+         * @MASK
+         *
+         * The DX10 version restricts the passes with the stencil buffer. Here,
+         * an optional mask marks the pixels that must be left out, like HUD
+         * overlays, letterbox bars or video in the UI: a FORMAT_R8 image of
+         * the size of the frames, nonzero where pixels are skipped. The mask
+         * is applied to the edges, which are dropped for masked pixels and
+         * for the ones next to them across the border, so nothing is blended
+         * into or out of the masked regions, and the searches stop at them.
+         * Masked pixels are thus left untouched (copied to 'dst' when it is
+         * not 'src'), and all the passes skip them quickly.
+         *
+         * It can also be given as a list of rectangles, which is rasterized
+         * into a mask of the current size. The image is not copied; pass
+         * Image() to process everything again.
+         */
+        class Rect {
+            public:
+                Rect(int x=0, int y=0, int width=0, int height=0)
+                    : x(x),
+                      y(y),
+                      width(width),
+                      height(height) {}
+
+            int x, y, width, height;
+        };
+
+        void setMask(const Image &mask);
+        void setMask(const Rect *rects, int count);
+        const Image &getMask() const { return mask; }
+
+        /**
+         * These two are just for debugging purposes. Edges are stored one byte
+         * per pixel (bit 0 is the left edge, bit 1 the top one), and blending
+         * weights as R8G8B8A8_UNORM, exactly as the GPU |blendTex| holds them.
+         * 'pass' selects the subsample for MODE_SMAA_S2X and MODE_SMAA_4X.
+         */
+        const Image &getEdgesImage(int pass=0) const { return edgesImage[pass]; }
+        const Image &getBlendImage(int pass=0) const { return blendImage[pass]; }
+
+    private:
+        class Parameters;
+        class PlaneBlend;
+
+        void reserveArena(size_t size);
+        void releaseArena();
+        unsigned char *carve(size_t size);
+        Parameters getParameters() const;
+        int getSubsampleIndex(Mode mode, int pass) const;
+
+        int prepare(const Plan &plan, const Image &src, const Image &dst, Mode mode);
+
+        // The passes run the row bands in [first, last), see @ASYNC:
+        void edgesDetectionPass(const Image &src, const Image &depth, const Plan &plan, int passes, int first, int last);
+        void blendingWeightsCalculationPass(const Plan &plan, Mode mode, int passes, int first, int last);
+        void saveBorders(const Plan &plan, const Image &src);
+        void neighborhoodBlendingPass(const Plan &plan, const Image &src, const Image &velocity, const Image &dst, int passes, int first, int last);
+        void chromaBlendingPass(const Image src[2], const Image dst[2]);
+        void planesBlendingPass(const Image *planes, const Image *planeDsts, int count, int passes);
+        static void packVelocityRow(const unsigned short *velocity, unsigned int *out, int width);
+
+        static void averageRow(const unsigned char *current, const unsigned char *previous, unsigned char *out, int size);
+        static void lerpRow(const unsigned char *current, const unsigned char *previous, unsigned char *out, int size, float weight);
+        void resolveRow(const Image &current, const Image &previous, const Image &velocity, const Image &dst, int y, float weight);
+
+        int width, height;
+        Preset preset;
+        bool predication, reprojection;
+
+        ThreadPool *pool;
+        bool ownsPool;
+
+        // The region all the buffers below are carved from, see
+        // @EXTERNAL_STORAGE:
+        unsigned char *arena;
+        size_t arenaSize, arenaUsed;
+        bool ownsArena, hugePages;
+
+        // One set for each subsample, the second one is only used when S2x or
+        // 4x are:
+        unsigned char *edges[2];
+        unsigned int *blend[2];
+        Image edgesImage[2], blendImage[2];
+
+        float *scratch;
+
+        // The plan of the last image, to skip the cache lookup while it
+        // doesn't change:
+        std::shared_ptr<const Plan> lastPlan;
+
+        // Used when blending in place, see neighborhoodBlendingPass:
+        unsigned char *borders;
+        unsigned long long *pending;
+
+        float threshold, cornerRounding;
+        int maxSearchSteps, maxSearchStepsDiag;
+
+        int frameIndex;
+        int msaaOrderMap[2];
+        SubsamplePattern pattern;
+
+        // See @MASK; the storage is only used for masks given as rectangles:
+        Image mask;
+        std::vector<unsigned char> maskStorage;
+
+        // What the last call to goCached saw, see @TILE_CACHE:
+        std::shared_ptr<const Plan> cachedPlan;
+        Mode cachedMode;
+        void *cachedOutput;
+        std::vector<unsigned long long> tileHashes;
+        std::vector<unsigned char> tileChanged;
+        std::vector<Rect> dirtyTiles;
+};
+
+#endif
@@ -0,0 +1,90 @@
+/**
+ * Copyright (C) 2013 Jorge Jimenez (jorge@iryoku.com)
+ * Copyright (C) 2013 Jose I. Echevarria (joseignacioechevarria@gmail.com)
+ * Copyright (C) 2013 Belen Masia (bmasia@unizar.es)
+ * Copyright (C) 2013 Fernando Navarro (fernandn@microsoft.com)
+ * Copyright (C) 2013 Diego Gutierrez (diegog@unizar.es)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software. As clarification, there
+ * is no requirement that the copyright notice and permission be included in
+ * binary distributions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include "TemporalSMAA.h"
+using namespace std;
+
+
+TemporalSMAA::TemporalSMAA(int width, int height, SMAA::Mode mode, SMAA::Preset preset, bool predication, bool reprojection, ThreadPool *pool)
+        : smaa(width, height, preset, predication, reprojection, pool),
+          mode(mode),
+          frames(0) {
+    assert(mode == SMAA::MODE_SMAA_T2X || mode == SMAA::MODE_SMAA_4X || mode == SMAA::MODE_SMAA_CUSTOM);
+
+    for (int i = 0; i < 2; i++) {
+        history[i].resize(size_t(width) * height * 4);
+        historyImage[i] = Image(history[i].data(), width, height, width * 4, Image::FORMAT_RGBA8);
+    }
+}
+
+
+void TemporalSMAA::go(const Image &src,
+                      const Image &depth,
+                      const Image &velocity,
+                      const Image &dst,
+                      SMAA::Input input) {
+    // The history is kept in the format of the input:
+    if (src.format != historyImage[0].format) {
+        int pitch = src.width * Image::bytesPerPixel(src.format);
+        for (int i = 0; i < 2; i++) {
+            history[i].resize(size_t(pitch) * src.height);
+            historyImage[i] = Image(history[i].data(), src.width, src.height, pitch, src.format);
+        }
+        frames = 0;
+    }
+
+    // Calculate next subpixel index:
+    int previousIndex = smaa.getFrameIndex() % 2;
+    int currentIndex = (smaa.getFrameIndex() + 1) % 2;
+    const Image &current = historyImage[currentIndex];
+
+    smaa.go(src, depth, velocity, current, input, mode);
+
+    if (frames == 0 || mode == SMAA::MODE_SMAA_CUSTOM) {
+        if (frames > 0) {
+            // Accumulate into the history; the new frame gets a weight of
+            // 1/count once 'count' frames are in (see TemporalSMAA.h):
+            int count = smaa.getSubsamplePattern().count;
+            float weight = 1.0f - 1.0f / float(min(frames + 1, count));
+            smaa.reproject(current, historyImage[previousIndex], velocity, current, weight);
+        }
+
+        // Nothing to resolve with yet, or already resolved in place:
+        for (int y = 0; y < current.height; y++)
+            memcpy(dst.row(y), current.row(y), current.pitch);
+    } else
+        smaa.reproject(current, historyImage[previousIndex], velocity, dst);
+
+    frames++;
+    smaa.nextFrame();
+}
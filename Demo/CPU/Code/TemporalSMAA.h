@@ -0,0 +1,98 @@
+/**
+ * Copyright (C) 2013 Jorge Jimenez (jorge@iryoku.com)
+ * Copyright (C) 2013 Jose I. Echevarria (joseignacioechevarria@gmail.com)
+ * Copyright (C) 2013 Belen Masia (bmasia@unizar.es)
+ * Copyright (C) 2013 Fernando Navarro (fernandn@microsoft.com)
+ * Copyright (C) 2013 Diego Gutierrez (diegog@unizar.es)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software. As clarification, there
+ * is no requirement that the copyright notice and permission be included in
+ * binary distributions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef TEMPORALSMAA_H
+#define TEMPORALSMAA_H
+
+#include <vector>
+#include "SMAA.h"
+
+/**
+ * Runs SMAA T2x or 4x over a stream of frames. It keeps the frame index, so
+ * that each frame gets the proper jitter and subsample indices, and the output
+ * of the previous frame, which is needed for the temporal resolve. This
+ * history is stored in two buffers allocated once, and recycled frame after
+ * frame.
+ *
+ * MODE_SMAA_CUSTOM is supported as well, once a pattern is set with
+ * getSMAA().setSubsamplePattern. As two frames are not enough for longer
+ * patterns, the history then accumulates all of them: the first 'count'
+ * frames are averaged with the same weight, and from then on each new frame
+ * is blended with a weight of 1/count, an exponential moving average where
+ * older frames fade out geometrically, by (1 - 1/count) per frame.
+ *
+ * The usual sequence is:
+ *    1. Render the frame, using the jitter from getJitter().
+ *    2. Call go(); this advances to the next frame.
+ */
+class TemporalSMAA {
+    public:
+        TemporalSMAA(int width, int height,
+                     SMAA::Mode mode=SMAA::MODE_SMAA_T2X,
+                     SMAA::Preset preset=SMAA::PRESET_HIGH, bool predication=false, bool reprojection=false,
+                     ThreadPool *pool=nullptr);
+
+        /**
+         * Same as SMAA::go ('src' must be 2x multisampled for 4x). 'dst'
+         * receives the resolved frame, in the format of 'src'; it can't be
+         * 'src'.
+         */
+        void go(const Image &src,
+                const Image &depth,
+                const Image &velocity,
+                const Image &dst,
+                SMAA::Input input);
+
+        /**
+         * Subpixel offset for the next frame, see SMAA::getJitter.
+         */
+        void getJitter(float jitter[2]) const { smaa.getJitter(mode, jitter); }
+
+        /**
+         * Discards the history, for example on camera cuts. The next frame is
+         * output without temporal resolve.
+         */
+        void reset() { frames = 0; }
+
+        /**
+         * Gives access to the underlying SMAA object, for changing the
+         * PRESET_CUSTOM parameters or debugging.
+         */
+        SMAA &getSMAA() { return smaa; }
+
+    private:
+        SMAA smaa;
+        SMAA::Mode mode;
+
+        std::vector<unsigned char> history[2];
+        Image historyImage[2];
+        int frames;
+};
+
+#endif
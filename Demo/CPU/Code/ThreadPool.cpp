@@ -0,0 +1,168 @@
+/**
+ * Copyright (C) 2013 Jorge Jimenez (jorge@iryoku.com)
+ * Copyright (C) 2013 Jose I. Echevarria (joseignacioechevarria@gmail.com)
+ * Copyright (C) 2013 Belen Masia (bmasia@unizar.es)
+ * Copyright (C) 2013 Fernando Navarro (fernandn@microsoft.com)
+ * Copyright (C) 2013 Diego Gutierrez (diegog@unizar.es)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software. As clarification, there
+ * is no requirement that the copyright notice and permission be included in
+ * binary distributions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include "ThreadPool.h"
+using namespace std;
+
+
+class ThreadPool::Job {
+    public:
+        Job(const function<void(int, int)> &body, int count)
+            : body(body), count(count), next(0), finished(0) {}
+
+        const function<void(int, int)> &body;
+        int count;
+        atomic<int> next, finished;
+        std::mutex doneMutex;
+        condition_variable done;
+};
+
+
+ThreadPool::ThreadPool(int threads) : stop(false), stopDriver(false) {
+    if (threads <= 0)
+        threads = max(int(thread::hardware_concurrency()), 1);
+
+    // The calling thread is also a worker:
+    for (int i = 1; i < threads; i++)
+        workers.push_back(thread(&ThreadPool::work, this, i));
+}
+
+
+ThreadPool::~ThreadPool() {
+    // The tasks left may still need the workers:
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopDriver = true;
+    }
+    tasksCondition.notify_one();
+    if (driver.joinable())
+        driver.join();
+
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    condition.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+}
+
+
+void ThreadPool::parallelFor(int count, const function<void(int, int)> &body) {
+    if (count <= 0)
+        return;
+
+    // Do not bother waking up anybody for a single item:
+    if (workers.empty() || count == 1) {
+        for (int i = 0; i < count; i++)
+            body(i, 0);
+        return;
+    }
+
+    shared_ptr<Job> job = make_shared<Job>(body, count);
+
+    // Enqueue one helper entry per worker that could take part:
+    int helpers = min(count - 1, int(workers.size()));
+    {
+        lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < helpers; i++)
+            queue.push_back(job);
+    }
+    if (helpers == int(workers.size()))
+        condition.notify_all();
+    else
+        for (int i = 0; i < helpers; i++)
+            condition.notify_one();
+
+    // Help while waiting:
+    run(*job, 0);
+
+    unique_lock<std::mutex> lock(job->doneMutex);
+    job->done.wait(lock, [&job] { return job->finished.load() == job->count; });
+}
+
+
+void ThreadPool::submit(function<void()> task) {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+        if (!driver.joinable())
+            driver = thread(&ThreadPool::drive, this);
+    }
+    tasksCondition.notify_one();
+}
+
+
+void ThreadPool::drive() {
+    for (;;) {
+        function<void()> task;
+        {
+            unique_lock<std::mutex> lock(mutex);
+            tasksCondition.wait(lock, [this] { return stopDriver || !tasks.empty(); });
+            if (stopDriver && tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+
+void ThreadPool::work(int thread) {
+    for (;;) {
+        shared_ptr<Job> job;
+        {
+            unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return stop || !queue.empty(); });
+            if (stop && queue.empty())
+                return;
+            job = queue.front();
+            queue.pop_front();
+        }
+        run(*job, thread);
+    }
+}
+
+
+void ThreadPool::run(Job &job, int thread) {
+    // Late helpers find nothing left to do, and never touch 'body', which
+    // may be gone by then:
+    int processed = 0;
+    for (int i = job.next++; i < job.count; i = job.next++) {
+        job.body(i, thread);
+        processed++;
+    }
+
+    if (processed > 0 && (job.finished += processed) == job.count) {
+        lock_guard<std::mutex> lock(job.doneMutex);
+        job.done.notify_all();
+    }
+}
@@ -0,0 +1,100 @@
+/**
+ * Copyright (C) 2013 Jorge Jimenez (jorge@iryoku.com)
+ * Copyright (C) 2013 Jose I. Echevarria (joseignacioechevarria@gmail.com)
+ * Copyright (C) 2013 Belen Masia (bmasia@unizar.es)
+ * Copyright (C) 2013 Fernando Navarro (fernandn@microsoft.com)
+ * Copyright (C) 2013 Diego Gutierrez (diegog@unizar.es)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software. As clarification, there
+ * is no requirement that the copyright notice and permission be included in
+ * binary distributions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A minimal pool of worker threads. Its only purpose is to spread the rows of
+ * each SMAA pass over the available cores, so it just offers a blocking
+ * parallel-for, and a background thread to drive asynchronous work from. A
+ * single pool can be shared among many SMAA objects.
+ */
+class ThreadPool {
+    public:
+        /**
+         * 'threads' is the total number of threads that will run the work,
+         * including the calling one. Zero means one per hardware thread.
+         */
+        ThreadPool(int threads=0);
+        ~ThreadPool();
+
+        /**
+         * Calls body(index, thread) for every index in [0, count), and
+         * returns when all of them have finished. The calling thread takes
+         * part in the work.
+         *
+         * 'thread' is in [0, getThreadCount()) and no two calls running at the
+         * same time inside a parallelFor get the same value, so it can be
+         * used to index per-thread scratch memory.
+         */
+        void parallelFor(int count, const std::function<void(int, int)> &body);
+
+        /**
+         * Runs 'task' on a background thread, created on first use and kept
+         * for the later tasks, which run one after the other. Tasks can call
+         * parallelFor as any other thread does; the workers can't, as they
+         * would wait on loops that only they can run.
+         *
+         * Tasks still queued when the pool is destroyed are run first.
+         */
+        void submit(std::function<void()> task);
+
+        int getThreadCount() const { return int(workers.size()) + 1; }
+
+    private:
+        class Job;
+
+        void work(int thread);
+        void drive();
+        static void run(Job &job, int thread);
+
+        std::vector<std::thread> workers;
+        std::deque<std::shared_ptr<Job>> queue;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stop;
+
+        // See submit:
+        std::thread driver;
+        std::deque<std::function<void()>> tasks;
+        std::condition_variable tasksCondition;
+        bool stopDriver;
+};
+
+#endif
@@ -0,0 +1,266 @@
+/**
+ * Copyright (C) 2013 Jorge Jimenez (jorge@iryoku.com)
+ * Copyright (C) 2013 Jose I. Echevarria (joseignacioechevarria@gmail.com)
+ * Copyright (C) 2013 Belen Masia (bmasia@unizar.es)
+ * Copyright (C) 2013 Fernando Navarro (fernandn@microsoft.com)
+ * Copyright (C) 2013 Diego Gutierrez (diegog@unizar.es)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software. As clarification, there
+ * is no requirement that the copyright notice and permission be included in
+ * binary distributions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include "VideoStream.h"
+using namespace std;
+
+
+namespace {
+
+/**
+ * BT.601 conversion coefficients, for limited and full range.
+ */
+struct YUVMatrix {
+    float yScale, yOffset;
+    float rv, gu, gv, bu; // To RGB
+    float yr, yg, yb, ur, ug, ub, vr, vg, vb; // To YUV
+};
+
+const YUVMatrix limitedRange = {
+    255.0f / 219.0f, 16.0f,
+    1.596027f, -0.391762f, -0.812968f, 2.017232f,
+    0.256788f, 0.504129f, 0.097906f, -0.148223f, -0.290993f, 0.439216f, 0.439216f, -0.367788f, -0.071427f
+};
+
+const YUVMatrix fullRange = {
+    1.0f, 0.0f,
+    1.402f, -0.344136f, -0.714136f, 1.772f,
+    0.299f, 0.587f, 0.114f, -0.168736f, -0.331264f, 0.5f, 0.5f, -0.418688f, -0.081312f
+};
+
+inline unsigned char saturate(float v) {
+    return (unsigned char) min(max(int(v + 0.5f), 0), 255);
+}
+
+} // namespace
+
+
+VideoStream::VideoStream(const Image *raw)
+        : raw(raw != nullptr),
+          width(raw? raw->width : 0),
+          height(raw? raw->height : 0),
+          format(raw? raw->format : Image::FORMAT_RGBA8),
+          frameSize(raw? size_t(raw->width) * raw->height * Image::bytesPerPixel(raw->format) : 0),
+          chromaShiftX(1),
+          chromaShiftY(1),
+          mono(false),
+          fullRange(false) {}
+
+
+bool VideoStream::readHeader(FILE *in) {
+    if (raw)
+        return true;
+
+    header.clear();
+    for (int c = fgetc(in); c != '\n'; c = fgetc(in)) {
+        if (c == EOF || header.size() > 4096) {
+            error = "truncated YUV4MPEG2 header";
+            return false;
+        }
+        header += char(c);
+    }
+
+    istringstream s(header);
+    string token;
+    s >> token;
+    if (token != "YUV4MPEG2") {
+        error = "not a YUV4MPEG2 stream";
+        return false;
+    }
+
+    string colorspace = "420jpeg";
+    while (s >> token) {
+        switch (token[0]) {
+            case 'W': width = atoi(token.c_str() + 1); break;
+            case 'H': height = atoi(token.c_str() + 1); break;
+            case 'C': colorspace = token.substr(1); break;
+            case 'X': if (token == "XCOLORRANGE=FULL") fullRange = true; break;
+        }
+    }
+
+    if (colorspace == "420jpeg" || colorspace == "420paldv" || colorspace == "420mpeg2" || colorspace == "420")
+        chromaShiftX = 1, chromaShiftY = 1;
+    else if (colorspace == "422")
+        chromaShiftX = 1, chromaShiftY = 0;
+    else if (colorspace == "444")
+        chromaShiftX = 0, chromaShiftY = 0;
+    else if (colorspace == "mono")
+        mono = true;
+    else {
+        error = "unsupported YUV4MPEG2 colorspace C" + colorspace + " (only 8-bit 4:2:0, 4:2:2, 4:4:4 and mono are)";
+        return false;
+    }
+    if (width <= 0 || height <= 0) {
+        error = "invalid YUV4MPEG2 frame size";
+        return false;
+    }
+
+    size_t chroma = size_t((width + (1 << chromaShiftX) - 1) >> chromaShiftX) * ((height + (1 << chromaShiftY) - 1) >> chromaShiftY);
+    frameSize = size_t(width) * height + (mono? 0 : 2 * chroma);
+    return true;
+}
+
+
+bool VideoStream::writeHeader(FILE *out) const {
+    if (raw)
+        return true;
+    return fprintf(out, "%s\n", header.c_str()) > 0;
+}
+
+
+bool VideoStream::readFrame(FILE *in, unsigned char *data, string &frameHeader) {
+    frameHeader.clear();
+    if (!raw) {
+        int c = fgetc(in);
+        if (c == EOF)
+            return false;
+        for (; c != '\n'; c = fgetc(in)) {
+            if (c == EOF || frameHeader.size() > 4096) {
+                error = "truncated frame header";
+                return false;
+            }
+            frameHeader += char(c);
+        }
+        if (frameHeader.compare(0, 5, "FRAME") != 0) {
+            error = "invalid frame header";
+            return false;
+        }
+    }
+
+    size_t read = fread(data, 1, frameSize, in);
+    if (read != frameSize) {
+        if (read > 0 || !raw)
+            error = "truncated frame";
+        return false;
+    }
+    return true;
+}
+
+
+bool VideoStream::writeFrame(FILE *out, const unsigned char *data, const string &frameHeader) const {
+    if (!raw && fprintf(out, "%s\n", frameHeader.c_str()) < 0)
+        return false;
+    return fwrite(data, 1, frameSize, out) == frameSize;
+}
+
+
+void VideoStream::getPlanes(unsigned char *yuv, Image planes[3]) const {
+    const int chromaWidth = (width + (1 << chromaShiftX) - 1) >> chromaShiftX;
+    const int chromaHeight = (height + (1 << chromaShiftY) - 1) >> chromaShiftY;
+    unsigned char *Y = yuv;
+    planes[0] = Image(Y, width, height, width, Image::FORMAT_R8);
+    planes[1] = planes[2] = Image();
+    if (!mono) {
+        unsigned char *U = Y + size_t(width) * height;
+        planes[1] = Image(U, chromaWidth, chromaHeight, chromaWidth, Image::FORMAT_R8);
+        planes[2] = Image(U + size_t(chromaWidth) * chromaHeight, chromaWidth, chromaHeight, chromaWidth, Image::FORMAT_R8);
+    }
+}
+
+
+void VideoStream::toRGBA(const unsigned char *yuv, const Image &rgba) const {
+    const YUVMatrix &m = fullRange? ::fullRange : limitedRange;
+    const int chromaWidth = (width + (1 << chromaShiftX) - 1) >> chromaShiftX;
+    const size_t chromaSize = size_t(chromaWidth) * ((height + (1 << chromaShiftY) - 1) >> chromaShiftY);
+    const unsigned char *Y = yuv;
+    const unsigned char *U = Y + size_t(width) * height;
+    const unsigned char *V = U + chromaSize;
+
+    for (int y = 0; y < height; y++) {
+        unsigned char *out = rgba.row(y);
+        const unsigned char *Yrow = Y + size_t(y) * width;
+        const unsigned char *Urow = U + size_t(y >> chromaShiftY) * chromaWidth;
+        const unsigned char *Vrow = V + size_t(y >> chromaShiftY) * chromaWidth;
+        for (int x = 0; x < width; x++) {
+            float l = m.yScale * (float(Yrow[x]) - m.yOffset);
+            float u = mono? 0.0f : float(Urow[x >> chromaShiftX]) - 128.0f;
+            float v = mono? 0.0f : float(Vrow[x >> chromaShiftX]) - 128.0f;
+            out[4 * x] = saturate(l + m.rv * v);
+            out[4 * x + 1] = saturate(l + m.gu * u + m.gv * v);
+            out[4 * x + 2] = saturate(l + m.bu * u);
+            out[4 * x + 3] = 255;
+        }
+    }
+}
+
+
+void VideoStream::fromRGBA(const Image &rgb, const Image &aa, unsigned char *yuv) const {
+    const YUVMatrix &m = fullRange? ::fullRange : limitedRange;
+    const int chromaWidth = (width + (1 << chromaShiftX) - 1) >> chromaShiftX;
+    const int chromaHeight = (height + (1 << chromaShiftY) - 1) >> chromaShiftY;
+    unsigned char *Y = yuv;
+    unsigned char *U = Y + size_t(width) * height;
+    unsigned char *V = U + size_t(chromaWidth) * chromaHeight;
+
+    auto changed = [&](int x, int y) {
+        return memcmp(rgb.row(y) + 4 * x, aa.row(y) + 4 * x, 3) != 0;
+    };
+
+    for (int y = 0; y < height; y++) {
+        const unsigned char *p = aa.row(y);
+        for (int x = 0; x < width; x++, p += 4) {
+            if (changed(x, y))
+                Y[size_t(y) * width + x] = saturate(m.yOffset + m.yr * p[0] + m.yg * p[1] + m.yb * p[2]);
+        }
+    }
+
+    if (mono)
+        return;
+
+    // Each chroma sample is the average of the pixels it covers, if any of
+    // them changed:
+    for (int cy = 0; cy < chromaHeight; cy++) {
+        for (int cx = 0; cx < chromaWidth; cx++) {
+            int x0 = cx << chromaShiftX, x1 = min(x0 + (1 << chromaShiftX), width);
+            int y0 = cy << chromaShiftY, y1 = min(y0 + (1 << chromaShiftY), height);
+            bool any = false;
+            for (int y = y0; y < y1 && !any; y++)
+                for (int x = x0; x < x1 && !any; x++)
+                    any = changed(x, y);
+            if (!any)
+                continue;
+
+            float u = 0.0f, v = 0.0f;
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) {
+                    const unsigned char *p = aa.row(y) + 4 * x;
+                    u += m.ur * p[0] + m.ug * p[1] + m.ub * p[2];
+                    v += m.vr * p[0] + m.vg * p[1] + m.vb * p[2];
+                }
+            }
+            float n = float((x1 - x0) * (y1 - y0));
+            U[size_t(cy) * chromaWidth + cx] = saturate(u / n + 128.0f);
+            V[size_t(cy) * chromaWidth + cx] = saturate(v / n + 128.0f);
+        }
+    }
+}
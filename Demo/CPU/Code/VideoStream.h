@@ -0,0 +1,111 @@
+/**
+ * Copyright (C) 2013 Jorge Jimenez (jorge@iryoku.com)
+ * Copyright (C) 2013 Jose I. Echevarria (joseignacioechevarria@gmail.com)
+ * Copyright (C) 2013 Belen Masia (bmasia@unizar.es)
+ * Copyright (C) 2013 Fernando Navarro (fernandn@microsoft.com)
+ * Copyright (C) 2013 Diego Gutierrez (diegog@unizar.es)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software. As clarification, there
+ * is no requirement that the copyright notice and permission be included in
+ * binary distributions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef VIDEOSTREAM_H
+#define VIDEOSTREAM_H
+
+#include <cstdio>
+#include <string>
+#include "Image.h"
+
+/**
+ * An uncompressed video stream, read and written frame by frame:
+ *     YUV4MPEG2: 8-bit 4:2:0, 4:2:2, 4:4:4 or mono. Frames are handed to
+ *                SMAA::goYUV as planes, or converted to FORMAT_RGBA8 for
+ *                color edge detection (BT.601, limited range unless
+ *                XCOLORRANGE=FULL) and back; only the pixels that SMAA
+ *                changed are converted back, so that the rest of the frame
+ *                stays bit exact.
+ *     Raw: frames of a size and format given by the caller, back to back,
+ *          handed to SMAA as they are.
+ */
+class VideoStream {
+    public:
+        /**
+         * For raw streams, 'raw' gives the size and format of the frames
+         * (its data and pitch are ignored).
+         */
+        VideoStream(const Image *raw=nullptr);
+
+        /**
+         * Reads the stream header, for YUV4MPEG2, and writes it back to
+         * 'out'. Returns false on failure, see getError().
+         */
+        bool readHeader(FILE *in);
+        bool writeHeader(FILE *out) const;
+
+        /**
+         * Reads the next frame into 'data', as stored in the stream, and the
+         * frame header into 'header'. Returns false at the end of the stream.
+         * Frames take getFrameSize() bytes, wherever they are stored (see
+         * FramePool.h).
+         */
+        bool readFrame(FILE *in, unsigned char *data, std::string &header);
+        bool writeFrame(FILE *out, const unsigned char *data, const std::string &header) const;
+
+        /**
+         * Tells whether the frames need to be converted to be processed.
+         */
+        bool isYUV() const { return !raw; }
+
+        /**
+         * Returns views of the Y, U and V planes of a YUV frame, as
+         * FORMAT_R8 images. The chroma ones are empty for mono frames.
+         */
+        void getPlanes(unsigned char *yuv, Image planes[3]) const;
+
+        /**
+         * Converts a YUV frame to an FORMAT_RGBA8 image, and back. 'rgb' is
+         * the converted input, and 'aa' the antialiased one; 'yuv' must hold
+         * the input frame, and is updated where they differ.
+         */
+        void toRGBA(const unsigned char *yuv, const Image &rgba) const;
+        void fromRGBA(const Image &rgb, const Image &aa, unsigned char *yuv) const;
+
+        int getWidth() const { return width; }
+        int getHeight() const { return height; }
+        Image::Format getFormat() const { return format; }
+        size_t getFrameSize() const { return frameSize; }
+        const std::string &getError() const { return error; }
+
+    private:
+        bool raw;
+        int width, height;
+        Image::Format format;
+        size_t frameSize;
+
+        // YUV4MPEG2 only:
+        std::string header;
+        int chromaShiftX, chromaShiftY; // Log2 of the subsampling
+        bool mono, fullRange;
+
+        std::string error;
+};
+
+#endif
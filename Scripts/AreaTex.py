@@ -6,11 +6,24 @@
 # Requires:
 #   - Python 3.3.2: http://www.python.org/
 #   - Pillow 2.1.0: https://pypi.python.org/pypi/Pillow/2.1.0#downloads
+#
+# Usage:
+#   AreaTex.py
+#       Creates the standard texture, with the subsample offsets required by
+#       SMAA 1x, T2x, S2x and 4x.
+#   AreaTex.py --jitter halton|r2 --samples N
+#       Appends the subsample offsets required by temporal supersampling with
+#       the first N points of the given sequence, and also outputs the jitter
+#       and subsample indices of each frame (see @SUBSAMPLE_PATTERN in the CPU
+#       demo). The textures are saved with the name of the sequence and the
+#       number of samples appended (for example, AreaTexDX10Halton8.tga and
+#       AreaTexDX9Halton8.tga), so that the standard ones are not overwritten.
 
 from PIL import Image
 from multiprocessing import *
 from math import *
 from tempfile import *
+import argparse
 import operator
 
 # Subsample offsets for orthogonal and diagonal areas:
@@ -27,6 +40,14 @@ SUBSAMPLE_OFFSETS_DIAG  = [( 0.00,   0.00),  #0
                            ( 0.125, -0.125), #3
                            (-0.125,  0.125)] #4
 
+# Extra subsample offsets are appended at the end of the lists above, so that
+# the indices of SMAA T2x and 4x are kept:
+#   - The sample position (x, y) (bottom-to-top y axis) is at offset -x for
+#     vertical lines, and y for horizontal ones.
+#   - It's at offset (d, -d) for diagonal lines, with d = (x - y) / 2 for the
+#     '/' ones, and d = (x + y) / 2 for the '\' ones.
+# Each offset takes a slot of 5 * SIZE_ORTHO (or 4 * SIZE_DIAG) rows.
+
 # Texture sizes:
 # (it's quite possible that this is not easily configurable)
 SIZE_ORTHO = 16 # * 5 slots = 80
@@ -55,11 +76,11 @@ def bytes(v):
     return tuple([int(255.0 * a) for a in v])
 
 # Prints C++ code encoding a texture:
-def cpp(image):
+def cpp(image, name):
     n = 0
     last = 2 * (image.size[0] * image.size[1]) - 1
 
-    print("static const unsigned char areaTexBytes[] = {")
+    print("static const unsigned char %sBytes[] = {" % name)
     print("   ", end=" ")
     for y in range(image.size[1]):
         for x in range(image.size[0]):
@@ -112,6 +133,60 @@ def smootharea(d, a1, a2):
     p = saturate(d / float(SMOOTH_MAX_DISTANCE))
     return lerp(b1, a1, p), lerp(b2, a2, p)
 
+#------------------------------------------------------------------------------
+# Subsample Patterns
+
+# Radical inverse of 'i' in the given base:
+def halton(i, base):
+    f, r = 1.0, 0.0
+    while i > 0:
+        f /= base
+        r += f * (i % base)
+        i //= base
+    return r
+
+# Jitters for temporal supersampling, in pixels, centered and with a
+# bottom-to-top y axis (as returned by SMAA::getJitter):
+def jitters(sequence, samples):
+    if sequence == "halton":
+        return [(halton(i + 1, 2) - 0.5, halton(i + 1, 3) - 0.5) for i in range(samples)]
+    else: # R2, see "The Unreasonable Effectiveness of Quasirandom Sequences"
+        g = 1.32471795724474602596
+        a1, a2 = 1.0 / g, 1.0 / (g * g)
+        return [(modf(0.5 + a1 * (i + 1))[0] - 0.5, modf(0.5 + a2 * (i + 1))[0] - 0.5) for i in range(samples)]
+
+# Finds the slot of an offset, appending it to the list if not there yet:
+def slot(offsets, offset):
+    for i, o in enumerate(offsets):
+        d = max(abs(a - b) for a, b in zip(o, offset)) if isinstance(o, tuple) else abs(o - offset)
+        if d < 1e-6:
+            return i
+    offsets.append(offset)
+    return len(offsets) - 1
+
+# Calculates the subsample indices of each jitter, adding the required slots:
+def subsampleindices(jitters):
+    indices = []
+    for jx, jy in jitters:
+        x, y = -jx, -jy # Moving the geometry moves the samples the other way around
+        indices.append((slot(SUBSAMPLE_OFFSETS_ORTHO, -x),
+                        slot(SUBSAMPLE_OFFSETS_ORTHO, y),
+                        slot(SUBSAMPLE_OFFSETS_DIAG, ((x - y) / 2.0, -(x - y) / 2.0)),
+                        slot(SUBSAMPLE_OFFSETS_DIAG, ((x + y) / 2.0, -(x + y) / 2.0))))
+    return indices
+
+# Prints C++ code with the jitters and subsample indices of a pattern:
+def cpppattern(name, jitters, indices):
+    print("static const float %sJitters[][2] = {" % name)
+    for j in jitters:
+        print("    { % .8ff, % .8ff }," % j)
+    print("};")
+    print()
+    print("static const float %sSubsampleIndices[][4] = {" % name)
+    for i in indices:
+        print("    { %d.0f, %d.0f, %d.0f, %d.0f }," % i)
+    print("};")
+
 #------------------------------------------------------------------------------
 # Mapping Functions (for placing each pattern subtexture into its place)
 
@@ -608,28 +683,49 @@ def tex4ddiag(tex4d, files, y, offset):
 # Entry Point
 
 # Copy the texture to a DirectX 9 friendly format:
-def dx9(tex4d):
+def dx9(tex4d, suffix):
     tex4d_dx9 = Image.new("RGBA", tex4d.size)
     for x in range(tex4d.size[0]):
         for y in range(tex4d.size[1]):
             p = tex4d.getpixel((x, y))
             tex4d_dx9.putpixel((x, y), la(p))
-    tex4d_dx9.save("AreaTexDX9.tga")
+    tex4d_dx9.save("AreaTexDX9%s.tga" % suffix)
 
 if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--jitter", choices=["halton", "r2"], help="temporal supersampling sequence")
+    parser.add_argument("--samples", type=int, default=8, help="number of points of the sequence")
+    args = parser.parse_args()
+
+    # Add the slots for the subsample pattern:
+    suffix = ""
+    if args.jitter:
+        pattern = jitters(args.jitter, args.samples)
+        indices = subsampleindices(pattern)
+        suffix = "%s%d" % (args.jitter.capitalize(), args.samples)
+
     # Create temporal textures:
     files = [NamedTemporaryFile(delete=False) for i in range(16)]
 
     # Create AreaTexDX10:
-    tex4d = Image.new("RGBA", (2 * 5 * SIZE_ORTHO, len(SUBSAMPLE_OFFSETS_ORTHO) * 5 * SIZE_ORTHO))
+    slots = max(len(SUBSAMPLE_OFFSETS_ORTHO), len(SUBSAMPLE_OFFSETS_DIAG))
+    tex4d = Image.new("RGBA", (2 * 5 * SIZE_ORTHO, slots * 5 * SIZE_ORTHO))
     for y, offset in enumerate(SUBSAMPLE_OFFSETS_ORTHO):
         tex4dortho(tex4d, files, y, offset)
     for y, offset in enumerate(SUBSAMPLE_OFFSETS_DIAG):
         tex4ddiag(tex4d, files, y, offset)
-    tex4d.save("AreaTexDX10.tga")
+    tex4d.save("AreaTexDX10%s.tga" % suffix)
 
     # Convert to DX9 (AreaTexDX9):
-    dx9(tex4d)
+    dx9(tex4d, suffix)
 
     # Output C++ code:
-    cpp(tex4d)
+    if args.jitter:
+        name = "areaTex" + suffix
+        print("#define %s_HEIGHT %d" % (name.upper(), tex4d.size[1]))
+        print()
+        cpp(tex4d, name)
+        print()
+        cpppattern(name, pattern, indices)
+    else:
+        cpp(tex4d, "areaTex")